@@ -332,11 +332,18 @@ findpkg_finish(TBB_MALLOC_PROXY)
 #parse all the version numbers from tbb
 if(NOT TBB_VERSION)
 
+ # oneTBB moved the version numbers from tbb/tbb_stddef.h to oneapi/tbb/version.h
+ if(EXISTS "${TBB_INCLUDE_DIR}/tbb/tbb_stddef.h")
+   set(TBB_VERSION_FILE "${TBB_INCLUDE_DIR}/tbb/tbb_stddef.h")
+ else()
+   set(TBB_VERSION_FILE "${TBB_INCLUDE_DIR}/oneapi/tbb/version.h")
+ endif()
+
  #only read the start of the file
  file(READ
-      "${TBB_INCLUDE_DIR}/tbb/tbb_stddef.h"
+      "${TBB_VERSION_FILE}"
       TBB_VERSION_CONTENTS
-      LIMIT 2048)
+      LIMIT 4096)
 
   string(REGEX REPLACE
     ".*#define TBB_VERSION_MAJOR ([0-9]+).*" "\\1"
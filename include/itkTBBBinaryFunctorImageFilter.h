@@ -0,0 +1,141 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBBinaryFunctorImageFilter_h
+#define itkTBBBinaryFunctorImageFilter_h
+
+#include "itkTBBImageToImageFilter.h"
+#include "itkTBBImageRowSpans.h"
+
+namespace itk
+{
+
+/**
+ * \class TBBBinaryFunctorImageFilter
+ *
+ * \brief TBBImageToImageFilter applying a functor to contiguous row spans of two inputs
+ *
+ * The binary version of TBBUnaryFunctorImageFilter: the functor receives raw pointers
+ * to the matching spans of the two inputs and of the output, and the number of pixels:
+ *
+ * \code
+ * struct Add
+ * {
+ *   void operator()(const Input1PixelType * input1, const Input2PixelType * input2,
+ *                   OutputPixelType * output, SizeValueType length) const
+ *   {
+ *     for (SizeValueType i = 0; i < length; ++i)
+ *       {
+ *       output[i] = input1[i] + input2[i];
+ *       }
+ *   }
+ * };
+ * \endcode
+ *
+ * The Jobs keep whole rows (see KeepWholeRows), and the rows of a Job are merged into
+ * one span when the requested region covers whole rows of the three buffers.
+ * Both inputs must have the same largest possible region as the output.
+ *
+ * The functor is called concurrently by the threads, and must not modify shared state.
+ *
+ * \warning Only for itk::Image (the spans address the pixel buffers directly).
+ *
+ * \sa TBBUnaryFunctorImageFilter, TBBImageRowSpans, BinaryFunctorImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TInputImage1    Type of the first input image.
+ * \tparam TInputImage2    Type of the second input image.
+ * \tparam TOutputImage    Type of the output image.
+ * \tparam TFunction       Type of the span functor.
+ */
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+class TBBBinaryFunctorImageFilter : public TBBImageToImageFilter< TInputImage1, TOutputImage >
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBBinaryFunctorImageFilter);
+
+  // Standard class type alias.
+  using Self = TBBBinaryFunctorImageFilter;
+  using Superclass = TBBImageToImageFilter< TInputImage1, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBBinaryFunctorImageFilter, TBBImageToImageFilter);
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  using Input1ImageType = TInputImage1;
+  using Input1ImagePixelType = typename TInputImage1::PixelType;
+  using Input2ImageType = TInputImage2;
+  using Input2ImagePixelType = typename TInputImage2::PixelType;
+
+  using FunctorType = TFunction;
+
+  static_assert(TInputImage1::ImageDimension == TOutputImage::ImageDimension &&
+                TInputImage2::ImageDimension == TOutputImage::ImageDimension,
+                "The input and output images must have the same dimension");
+
+  /** Set/Get the first and second inputs. */
+  void SetInput1(const TInputImage1 * image1);
+  void SetInput2(const TInputImage2 * image2);
+  const TInputImage1 * GetInput1() const;
+  const TInputImage2 * GetInput2() const;
+
+  /** Get/Set the span functor. Setting the functor calls Modified(). */
+  FunctorType & GetFunctor() { return m_Functor; }
+  const FunctorType & GetFunctor() const { return m_Functor; }
+  void SetFunctor(const FunctorType & functor)
+  {
+    m_Functor = functor;
+    this->Modified();
+  }
+
+  /** Gets the alignment (in bytes) of the rows of the input and output buffers
+   * during the last Update() (see TBBImageRowSpans::GetRowAlignment()). */
+  itkGetConstMacro(RowAlignment, SizeValueType);
+
+protected:
+  TBBBinaryFunctorImageFilter();
+  ~TBBBinaryFunctorImageFilter() override;
+
+  /** Computes the RowAlignment. */
+  void BeforeThreadedGenerateData() override;
+
+  /** Calls the functor on the row spans of the Job. */
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override;
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  FunctorType   m_Functor;
+  SizeValueType m_RowAlignment;
+};
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBBinaryFunctorImageFilter.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBBinaryFunctorImageFilter_h
@@ -0,0 +1,113 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBBinaryFunctorImageFilter_hxx
+#define itkTBBBinaryFunctorImageFilter_hxx
+
+#include "itkTBBBinaryFunctorImageFilter.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::TBBBinaryFunctorImageFilter():
+  m_RowAlignment(1)
+{
+  this->SetNumberOfRequiredInputs(2);
+  this->SetKeepWholeRows(true);
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::~TBBBinaryFunctorImageFilter()
+{
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+void TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::
+SetInput1(const TInputImage1 * image1)
+{
+  this->SetInput(image1);
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+void TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::
+SetInput2(const TInputImage2 * image2)
+{
+  this->SetNthInput(1, const_cast< TInputImage2 * >(image2));
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+const TInputImage1 * TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::
+GetInput1() const
+{
+  return this->GetInput();
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+const TInputImage2 * TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::
+GetInput2() const
+{
+  return static_cast< const TInputImage2 * >(this->ProcessObject::GetInput(1));
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+void TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::BeforeThreadedGenerateData()
+{
+  Superclass::BeforeThreadedGenerateData();
+
+  m_RowAlignment = std::min(std::min(TBBImageRowSpans::GetRowAlignment(this->GetInput1()),
+                                     TBBImageRowSpans::GetRowAlignment(this->GetInput2())),
+                            TBBImageRowSpans::GetRowAlignment(this->GetOutput()));
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+void TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::
+TBBGenerateData(const OutputImageRegionType& outputRegionForThread)
+{
+  const TInputImage1 * input1 = this->GetInput1();
+  const TInputImage2 * input2 = this->GetInput2();
+  TOutputImage * output = this->GetOutput();
+  const Input1ImagePixelType * input1Buffer = input1->GetBufferPointer();
+  const Input2ImagePixelType * input2Buffer = input2->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = output->GetBufferPointer();
+
+  TBBImageRowSpans::ForEachSpan(outputRegionForThread,
+                                { input1->GetBufferedRegion(), input2->GetBufferedRegion(),
+                                  output->GetBufferedRegion() },
+                                [&](const typename TOutputImage::IndexType & index, SizeValueType length)
+    {
+    m_Functor(input1Buffer + input1->ComputeOffset(index), input2Buffer + input2->ComputeOffset(index),
+              outputBuffer + output->ComputeOffset(index), length);
+    });
+}
+
+template< typename TInputImage1, typename TInputImage2, typename TOutputImage, typename TFunction >
+void TBBBinaryFunctorImageFilter< TInputImage1, TInputImage2, TOutputImage, TFunction >::
+PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Row alignment: "
+     << static_cast< typename NumericTraits< SizeValueType >::PrintType >( m_RowAlignment ) << std::endl;
+}
+
+}  //namespace itk
+
+#endif // itkTBBBinaryFunctorImageFilter_hxx
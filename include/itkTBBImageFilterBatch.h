@@ -0,0 +1,200 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBImageFilterBatch_h
+#define itkTBBImageFilterBatch_h
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <functional>
+#include <future>
+#include <vector>
+
+#ifndef ITK_USE_TBB
+#include <atomic>
+#include <exception>
+#include <mutex>
+#endif // ITK_USE_TBB
+
+namespace itk
+{
+
+/**
+ * \class TBBImageFilterBatch
+ *
+ * \brief Updates a TBB filter on a batch of images, in parallel within or across the images
+ *
+ * With small images, the Jobs of one Update() are too small to pay off and the threads
+ * are idle between the Update() calls. TBBImageFilterBatch updates one filter per input
+ * image (created by the FilterFactory) in one task arena, and chooses the parallelism
+ * from the decomposition of the first image:
+ * - within the images: the images are updated one after the other, each split into Jobs
+ *   executed by all the threads (large images);
+ * - across the images: the images are updated concurrently, each by a single task
+ *   (small images: fewer Jobs than threads, or less than MinimumTaskCost per thread).
+ *
+ * \example :
+ *   batch->SetFilterFactory([]() { FilterType::Pointer filter = FilterType::New(); ...; return filter; });
+ *   for (...) batch->AddInput(slice);
+ *   std::future< void > done = batch->UpdateAsync();
+ *   ...
+ *   done.get();                       // rethrows the exception of a failed Update()
+ *   batch->GetOutput(i);
+ *
+ * The outputs are disconnected from their filter, so they are kept until the next Update().
+ *
+ * \warning The inputs must be distinct images already up to date (e.g. read or disconnected):
+ *          their requested regions are set concurrently by the filters.
+ *
+ * \sa TBBImageToImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TFilter     Type of the filter, a TBBImageToImageFilter.
+ */
+template< typename TFilter >
+class TBBImageFilterBatch : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBImageFilterBatch);
+
+  // Standard class type alias.
+  using Self = TBBImageFilterBatch;
+  using Superclass = Object;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBImageFilterBatch, Object);
+
+  using FilterType = TFilter;
+  using FilterPointer = typename FilterType::Pointer;
+  using InputImageType = typename FilterType::InputImageType;
+  using InputImageConstPointer = typename InputImageType::ConstPointer;
+  using OutputImageType = typename FilterType::OutputImageType;
+  using OutputImagePointer = typename OutputImageType::Pointer;
+
+  /** Type of the function creating (and configuring) the filter of an image */
+  using FilterFactoryType = std::function< FilterPointer() >;
+#ifdef ITK_USE_TBB
+  using TaskArenaPointer = typename FilterType::TaskArenaPointer;
+#endif // ITK_USE_TBB
+
+  /** Parallelism of the batch */
+  enum ParallelismType
+    {
+    AutomaticParallelism = 0, // Chosen from the decomposition of the first image
+    WithinImages,             // One image after the other, all the threads on each image
+    AcrossImages              // Several images at once, one task per image
+    };
+
+  /** Set/Get the function creating the filter of each image (default: FilterType::New()).
+   * The TaskArena (or the NumberOfThreads) of the filters is set by the batch, and their
+   * GrainSize when the parallelism is across the images.
+   * The factory is always called in the thread of the Update() (all the filters updated
+   * across the images are created before), so it doesn't need to be thread safe. */
+  void SetFilterFactory(const FilterFactoryType & filterFactory);
+  const FilterFactoryType & GetFilterFactory() const;
+
+  /** Appends an image to the batch. */
+  void AddInput(const InputImageType * image);
+
+  /** Removes all the images (and the outputs). */
+  void ClearInputs();
+
+  /** Gets the number of images of the batch. */
+  unsigned int GetNumberOfInputs() const;
+
+  /** Gets the output of the image i (null before the Update()). */
+  OutputImageType * GetOutput(unsigned int i) const;
+
+  /** Set/Get the parallelism (AutomaticParallelism by default). */
+  itkSetMacro(Parallelism, ParallelismType);
+  itkGetConstMacro(Parallelism, ParallelismType);
+
+  /** Gets the parallelism used by the last Update() (resolves the AutomaticParallelism). */
+  itkGetConstMacro(SelectedParallelism, ParallelismType);
+
+  /** Set/Get the number of threads executing the batch.
+   * With TBB, the concurrency of the task arena (0 : default TBB concurrency). */
+  void SetNumberOfThreads(ThreadIdType numberOfThreads);
+  itkGetConstMacro(NumberOfThreads, ThreadIdType);
+
+#ifdef ITK_USE_TBB
+  /** Set/Get the TBB task arena executing the batch (see TBBImageToImageFilter::SetTaskArena()). */
+  void SetTaskArena(const TaskArenaPointer & taskArena);
+  TaskArenaPointer GetTaskArena() const;
+#endif // ITK_USE_TBB
+
+  /** Updates the filters of all the images.
+   * \exception The first exception thrown by a filter. */
+  void Update();
+
+  /** Starts the Update() in another thread: the future is ready at the end of the Update(),
+   * and rethrows its exception. The batch must not be modified before. */
+  std::future< void > UpdateAsync();
+
+protected:
+  TBBImageFilterBatch();
+  ~TBBImageFilterBatch() override;
+
+  /** Creates a filter with the FilterFactory, and sets its parallelism (Internal). */
+  FilterPointer CreateFilter(bool acrossImages) const;
+
+  /** Updates the filter with the image i, and keeps its output (Internal). */
+  void UpdateImage(FilterType * filter, SizeValueType i);
+
+#ifndef ITK_USE_TBB
+  /** Internal function. Callback method for the multithreader: updates the next images. */
+  static ITK_THREAD_RETURN_TYPE AcrossImagesThreaderCallback( void *arg );
+#endif // ITK_USE_TBB
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  FilterFactoryType                     m_FilterFactory;
+  std::vector< InputImageConstPointer > m_Inputs;
+  std::vector< OutputImagePointer >     m_Outputs;
+  ParallelismType                       m_Parallelism;
+  ParallelismType                       m_SelectedParallelism;
+  ThreadIdType                          m_NumberOfThreads;
+
+  // Filters of the images updated across the images, released once updated
+  std::vector< FilterPointer >          m_AcrossImagesFilters;
+
+#ifdef ITK_USE_TBB
+  // Injected task arena (null : shared arena of m_NumberOfThreads).
+  TaskArenaPointer                      m_TaskArena;
+#else
+  // Next image to update, and first exception of the threads
+  std::atomic< SizeValueType >          m_NextImage;
+  std::exception_ptr                    m_Exception;
+  std::mutex                            m_ExceptionMutex;
+#endif // ITK_USE_TBB
+};
+
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBImageFilterBatch.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBImageFilterBatch_h
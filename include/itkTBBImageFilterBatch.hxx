@@ -0,0 +1,300 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBImageFilterBatch_hxx
+#define itkTBBImageFilterBatch_hxx
+
+#include "itkTBBImageFilterBatch.h"
+
+#include <algorithm>
+
+#ifdef ITK_USE_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#endif // ITK_USE_TBB
+
+namespace itk
+{
+
+template< typename TFilter >
+TBBImageFilterBatch< TFilter >::TBBImageFilterBatch():
+  m_FilterFactory([]() { return FilterType::New(); }),
+  m_Parallelism(AutomaticParallelism),
+  m_SelectedParallelism(AutomaticParallelism),
+  m_NumberOfThreads(0)
+{
+#ifndef ITK_USE_TBB
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  m_NextImage = 0;
+#endif // ITK_USE_TBB
+}
+
+template< typename TFilter >
+TBBImageFilterBatch< TFilter >::~TBBImageFilterBatch()
+{
+}
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::SetFilterFactory(const FilterFactoryType & filterFactory)
+{
+  m_FilterFactory = filterFactory;
+  this->Modified();
+}
+
+template< typename TFilter >
+const typename TBBImageFilterBatch< TFilter >::FilterFactoryType &
+TBBImageFilterBatch< TFilter >::GetFilterFactory() const
+{
+  return m_FilterFactory;
+}
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::AddInput(const InputImageType * image)
+{
+  m_Inputs.push_back(image);
+  this->Modified();
+}
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::ClearInputs()
+{
+  m_Inputs.clear();
+  m_Outputs.clear();
+  this->Modified();
+}
+
+template< typename TFilter >
+unsigned int TBBImageFilterBatch< TFilter >::GetNumberOfInputs() const
+{
+  return static_cast< unsigned int >(m_Inputs.size());
+}
+
+template< typename TFilter >
+typename TBBImageFilterBatch< TFilter >::OutputImageType *
+TBBImageFilterBatch< TFilter >::GetOutput(unsigned int i) const
+{
+  if (i >= m_Outputs.size())
+    {
+    return nullptr;
+    }
+  return m_Outputs[i].GetPointer();
+}
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::SetNumberOfThreads(ThreadIdType numberOfThreads)
+{
+  m_NumberOfThreads = numberOfThreads;
+#ifdef ITK_USE_TBB
+  m_TaskArena.reset();
+#endif // ITK_USE_TBB
+  this->Modified();
+}
+
+#ifdef ITK_USE_TBB
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::SetTaskArena(const TaskArenaPointer & taskArena)
+{
+  if (taskArena)
+    {
+    taskArena->initialize();
+    m_NumberOfThreads = static_cast< ThreadIdType >(taskArena->max_concurrency());
+    }
+  m_TaskArena = taskArena;
+  this->Modified();
+}
+
+template< typename TFilter >
+typename TBBImageFilterBatch< TFilter >::TaskArenaPointer
+TBBImageFilterBatch< TFilter >::GetTaskArena() const
+{
+  if (m_TaskArena)
+    {
+    return m_TaskArena;
+    }
+  return TBBTaskArenaPool::GetTaskArena(static_cast< int >(m_NumberOfThreads));
+}
+#endif // ITK_USE_TBB
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::Update()
+{
+  const SizeValueType numberOfImages = m_Inputs.size();
+  m_Outputs.assign(numberOfImages, OutputImagePointer());
+  m_SelectedParallelism = m_Parallelism;
+  if (numberOfImages == 0)
+    {
+    return;
+    }
+
+#ifdef ITK_USE_TBB
+  const TaskArenaPointer taskArena = this->GetTaskArena();
+  const ThreadIdType numberOfThreads = static_cast< ThreadIdType >(taskArena->max_concurrency());
+#else
+  const ThreadIdType numberOfThreads = std::max< ThreadIdType >(1, m_NumberOfThreads);
+#endif // ITK_USE_TBB
+
+  // The first image is updated alone, and its decomposition chooses how the other images are updated:
+  // across the images when it doesn't provide a Job, and MinimumTaskCost, to each thread
+  SizeValueType firstImage = 0;
+  if (m_Parallelism != AcrossImages)
+    {
+    const FilterPointer filter = this->CreateFilter(false);
+    this->UpdateImage(filter, 0);
+    firstImage = 1;
+    if (m_Parallelism == AutomaticParallelism)
+      {
+      const bool fewJobs = filter->GetNumberOfJobs() < numberOfThreads;
+      const bool cheapJobs = filter->GetJobDecompositionCost() <
+        static_cast< double >(FilterType::MinimumTaskCost) * numberOfThreads;
+      m_SelectedParallelism = (numberOfImages > 1 && (fewJobs || cheapJobs)) ? AcrossImages : WithinImages;
+      }
+    }
+
+  itkDebugMacro(<< "Batch: " << numberOfImages << " images, " << numberOfThreads << " threads, "
+                << (m_SelectedParallelism == AcrossImages ? "across" : "within") << " the images" << std::endl)
+
+  if (m_SelectedParallelism == WithinImages)
+    {
+    for (SizeValueType i = firstImage; i < numberOfImages; ++i)
+      {
+      this->UpdateImage(this->CreateFilter(false), i);
+      }
+    return;
+    }
+
+  // The filters are created serially, so the FilterFactory is never called concurrently
+  m_AcrossImagesFilters.assign(numberOfImages, FilterPointer());
+  for (SizeValueType i = firstImage; i < numberOfImages; ++i)
+    {
+    m_AcrossImagesFilters[i] = this->CreateFilter(true);
+    }
+
+#ifdef ITK_USE_TBB
+  // The filters of the images are nested in the parallel_for, in the same task arena
+  taskArena->execute([&]
+    {
+    tbb::parallel_for(firstImage, numberOfImages, [this](SizeValueType i)
+      {
+      const FilterPointer filter = m_AcrossImagesFilters[i];
+      m_AcrossImagesFilters[i] = nullptr;
+      this->UpdateImage(filter, i);
+      });
+    });
+  m_AcrossImagesFilters.clear();
+#else
+  // Each thread claims the next image
+  m_NextImage = firstImage;
+  m_Exception = nullptr;
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(this->AcrossImagesThreaderCallback, (void *)this);
+  threader->SingleMethodExecute();
+  m_AcrossImagesFilters.clear();
+  if (m_Exception)
+    {
+    std::rethrow_exception(m_Exception);
+    }
+#endif // ITK_USE_TBB
+}
+
+template< typename TFilter >
+std::future< void > TBBImageFilterBatch< TFilter >::UpdateAsync()
+{
+  // The batch is kept alive until the end of the Update()
+  const Pointer self = this;
+  return std::async(std::launch::async, [self]() { self->Update(); });
+}
+
+template< typename TFilter >
+typename TBBImageFilterBatch< TFilter >::FilterPointer
+TBBImageFilterBatch< TFilter >::CreateFilter(bool acrossImages) const
+{
+  FilterPointer filter = m_FilterFactory();
+#ifdef ITK_USE_TBB
+  filter->SetTaskArena(this->GetTaskArena());
+  if (acrossImages)
+    {
+    // A single task: the Jobs of the image are merged, and not split between the threads
+    filter->SetGrainSize(NumericTraits< typename FilterType::JobIdType >::max());
+    }
+#else
+  filter->SetNumberOfThreads(acrossImages ? 1 : std::max< ThreadIdType >(1, m_NumberOfThreads));
+#endif // ITK_USE_TBB
+  return filter;
+}
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::UpdateImage(FilterType * filter, SizeValueType i)
+{
+  filter->SetInput(m_Inputs[i]);
+  filter->Update();
+
+  OutputImagePointer output = filter->GetOutput();
+  output->DisconnectPipeline();
+  m_Outputs[i] = output;
+}
+
+#ifndef ITK_USE_TBB
+template< typename TFilter >
+ITK_THREAD_RETURN_TYPE TBBImageFilterBatch< TFilter >::AcrossImagesThreaderCallback( void *arg )
+{
+  using ThreadInfoType = MultiThreader::ThreadInfoStruct;
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  Self * batch = static_cast< Self * >(infoStruct->UserData);
+
+  try
+    {
+    for (SizeValueType i = batch->m_NextImage++; i < batch->m_Inputs.size(); i = batch->m_NextImage++)
+      {
+      const FilterPointer filter = batch->m_AcrossImagesFilters[i];
+      batch->m_AcrossImagesFilters[i] = nullptr;
+      batch->UpdateImage(filter, i);
+      }
+    }
+  catch ( ... )
+    {
+    // Rethrown by Update(), in the calling thread
+    std::lock_guard< std::mutex > lock(batch->m_ExceptionMutex);
+    if (!batch->m_Exception)
+      {
+      batch->m_Exception = std::current_exception();
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+#endif // ITK_USE_TBB
+
+template< typename TFilter >
+void TBBImageFilterBatch< TFilter >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Number of inputs: " << m_Inputs.size() << std::endl;
+  os << indent << "Parallelism: " << static_cast< int >( m_Parallelism ) << std::endl;
+  os << indent << "Selected parallelism: " << static_cast< int >( m_SelectedParallelism ) << std::endl;
+  os << indent << "Number of Threads: "
+     << static_cast< typename NumericTraits< ThreadIdType >::PrintType >( m_NumberOfThreads ) << std::endl;
+#ifdef ITK_USE_TBB
+  os << indent << "Task arena: " << (m_TaskArena ? "Set" : "Shared") << std::endl;
+#endif // ITK_USE_TBB
+}
+
+}  //namespace itk
+
+#endif // itkTBBImageFilterBatch_hxx
@@ -0,0 +1,159 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBImageFilterPipeline_h
+#define itkTBBImageFilterPipeline_h
+
+#include <itkImageToImageFilter.h>
+
+#include <functional>
+#include <vector>
+
+namespace itk
+{
+
+/**
+ * \class TBBImageFilterPipeline
+ *
+ * \brief Executes a chain of TBB filters region by region, materializing only the final output
+ *
+ * When TBB filters are chained, each stage allocates and sweeps a full-size output,
+ * so the memory traffic and the peak memory grow with the depth of the pipeline.
+ * TBBImageFilterPipeline executes its stages on one region (stream division) of the
+ * output at a time: the requested region is propagated through the stages, so each
+ * intermediate image only holds the division plus the halo needed by the next stages.
+ * The divisions of the last stage are copied into the output of the pipeline, and the
+ * intermediate images are released at the end of the Update().
+ *
+ * Each stage still splits its division into jobs and executes them in parallel.
+ * The results are identical to those of the chained stages, as long as each stage
+ * requests the input region it reads (GenerateInputRequestedRegion()).
+ *
+ * \example :
+ *   pipeline->SetInput(image);
+ *   pipeline->AddStage(smoothFilter);      // reads the input of the pipeline
+ *   pipeline->AddStage(thresholdFilter);   // reads the output of smoothFilter
+ *   pipeline->Update();                    // output of thresholdFilter
+ *
+ * \warning The halo of each division is computed again by the upstream stages:
+ *          the divisions should be large compared to the radius of the stages.
+ *
+ * \sa TBBImageToImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TInputImage     Type of the input image (input of the first stage).
+ * \tparam TOutputImage    Type of the output image (output of the last stage).
+ */
+template< typename TInputImage, typename TOutputImage >
+class TBBImageFilterPipeline : public ImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBImageFilterPipeline);
+
+  // Standard class type alias.
+  using Self = TBBImageFilterPipeline;
+  using Superclass = ImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBImageFilterPipeline, ImageToImageFilter);
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+
+  using InputImageType = TInputImage;
+  using InputImagePointer = typename InputImageType::Pointer;
+  using OutputImageType = TOutputImage;
+
+  /** Appends a stage to the pipeline.
+   * The first stage reads the input of the pipeline, the following stages read the output
+   * of the previous stage, and the output of the last stage is the output of the pipeline.
+   * The stages are connected at each Update(). */
+  template< typename TStage >
+  void AddStage(TStage * stage);
+
+  /** Removes all the stages */
+  void ClearStages();
+
+  /** Gets the number of stages */
+  unsigned int GetNumberOfStages() const;
+
+  /** Set/Get the number of divisions of the requested region.
+   * (NumberOfStreamDivisions == 0 : automatic, based on StreamCacheSize) */
+  itkSetMacro(NumberOfStreamDivisions, unsigned int);
+  itkGetConstMacro(NumberOfStreamDivisions, unsigned int);
+
+  /** Set/Get the number of bytes (output pixels of all the stages) an automatic division
+   * should fit in. (default: 16 MiB, the size of a typical last level cache) */
+  itkSetMacro(StreamCacheSize, SizeValueType);
+  itkGetConstMacro(StreamCacheSize, SizeValueType);
+
+protected:
+  TBBImageFilterPipeline();
+  ~TBBImageFilterPipeline() override;
+
+  /** Connects the stages, and copies the output information of the last stage. */
+  void GenerateOutputInformation() override;
+
+  /** Requests the largest possible region of the input, since the stages may need a halo
+   * around each division. */
+  void GenerateInputRequestedRegion() override;
+
+  /** Executes the stages on each division of the requested region. */
+  void GenerateData() override;
+
+  /** Connects the input of the pipeline and the stages (Internal). */
+  void ConnectStages();
+
+  /** Gets the number of divisions of the region
+   * (resolves the automatic NumberOfStreamDivisions). */
+  unsigned int GetStreamNumberOfDivisions(const OutputImageRegionType & region) const;
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  // A stage is connected through its typed SetInput() / GetOutput()
+  struct StageType
+    {
+    ProcessObject::Pointer                    Filter;
+    std::function< bool(DataObject *) >       ConnectInput;
+    std::function< DataObject *() >           GetOutput;
+    SizeValueType                             OutputPixelSize;
+    };
+
+  std::vector< StageType >    m_Stages;
+  unsigned int                m_NumberOfStreamDivisions;
+  SizeValueType               m_StreamCacheSize;
+
+  // Graft of the input of the pipeline, read by the first stage
+  // (keeps the divisions from being propagated upstream of the pipeline)
+  InputImagePointer           m_StagesInput;
+};
+
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBImageFilterPipeline.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBImageFilterPipeline_h
@@ -0,0 +1,218 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBImageFilterPipeline_hxx
+#define itkTBBImageFilterPipeline_hxx
+
+#include "itkTBBImageFilterPipeline.h"
+
+#include "itkImageAlgorithm.h"
+#include "itkImageRegionSplitterSlowDimension.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template< typename TInputImage, typename TOutputImage >
+TBBImageFilterPipeline< TInputImage, TOutputImage >::TBBImageFilterPipeline():
+  m_NumberOfStreamDivisions(0),
+  m_StreamCacheSize(16 * 1024 * 1024)
+{
+  m_StagesInput = InputImageType::New();
+}
+
+template< typename TInputImage, typename TOutputImage >
+TBBImageFilterPipeline< TInputImage, TOutputImage >::~TBBImageFilterPipeline()
+{
+}
+
+template< typename TInputImage, typename TOutputImage >
+template< typename TStage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::AddStage(TStage * stage)
+{
+  using StageInputImageType = typename TStage::InputImageType;
+  using StageOutputImageType = typename TStage::OutputImageType;
+
+  StageType newStage;
+  newStage.Filter = stage;
+  newStage.ConnectInput = [stage](DataObject * input)
+    {
+    StageInputImageType * stageInput = dynamic_cast< StageInputImageType * >(input);
+    if (stageInput == nullptr)
+      {
+      return false;
+      }
+    stage->SetInput(stageInput);
+    return true;
+    };
+  newStage.GetOutput = [stage]() -> DataObject *
+    {
+    return stage->GetOutput();
+    };
+  newStage.OutputPixelSize = sizeof(typename StageOutputImageType::PixelType);
+
+  m_Stages.push_back(newStage);
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::ClearStages()
+{
+  m_Stages.clear();
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage >
+unsigned int TBBImageFilterPipeline< TInputImage, TOutputImage >::GetNumberOfStages() const
+{
+  return static_cast< unsigned int >(m_Stages.size());
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::ConnectStages()
+{
+  if (m_Stages.empty())
+    {
+    itkExceptionMacro(<< "No stage in the pipeline");
+    }
+
+  m_StagesInput->CopyInformation(this->GetInput());
+
+  DataObject * stageInput = m_StagesInput;
+  for (unsigned int i = 0; i < m_Stages.size(); ++i)
+    {
+    if (!m_Stages[i].ConnectInput(stageInput))
+      {
+      itkExceptionMacro(<< "The input of the stage " << i << " (" << m_Stages[i].Filter->GetNameOfClass()
+                        << ") doesn't match the output of the previous stage");
+      }
+    stageInput = m_Stages[i].GetOutput();
+    }
+
+  if (dynamic_cast< OutputImageType * >(stageInput) == nullptr)
+    {
+    itkExceptionMacro(<< "The output of the last stage (" << m_Stages.back().Filter->GetNameOfClass()
+                      << ") doesn't match the output of the pipeline");
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::GenerateOutputInformation()
+{
+  Superclass::GenerateOutputInformation();
+
+  // The stages may change the size, spacing, ... of the images
+  this->ConnectStages();
+  OutputImageType * lastOutput = static_cast< OutputImageType * >(m_Stages.back().GetOutput());
+  lastOutput->UpdateOutputInformation();
+  this->GetOutput()->CopyInformation(lastOutput);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  InputImageType * input = const_cast< InputImageType * >(this->GetInput());
+  if (input)
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+unsigned int TBBImageFilterPipeline< TInputImage, TOutputImage >::
+GetStreamNumberOfDivisions(const OutputImageRegionType & region) const
+{
+  if (m_NumberOfStreamDivisions > 0)
+    {
+    return m_NumberOfStreamDivisions;
+    }
+
+  // Divisions of StreamCacheSize bytes, counting the output pixels of every stage
+  SizeValueType pixelSize = 0;
+  for (const StageType & stage : m_Stages)
+    {
+    pixelSize += stage.OutputPixelSize;
+    }
+  const SizeValueType cacheSize = std::max< SizeValueType >(1, m_StreamCacheSize);
+  const SizeValueType numberOfDivisions = (region.GetNumberOfPixels() * pixelSize + cacheSize - 1) / cacheSize;
+  return static_cast< unsigned int >(std::max< SizeValueType >(1, numberOfDivisions));
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::GenerateData()
+{
+  // Only the final output is allocated for the whole requested region
+  this->AllocateOutputs();
+  OutputImageType * output = this->GetOutput();
+  const OutputImageRegionType outputRegion = output->GetRequestedRegion();
+
+  // The first stage reads the buffer of the input, without updating upstream of the pipeline
+  this->ConnectStages();
+  m_StagesInput->Graft(this->GetInput());
+  OutputImageType * lastOutput = static_cast< OutputImageType * >(m_Stages.back().GetOutput());
+
+  // Divisions along the slowest dimension, so they are contiguous in the output buffer
+  ImageRegionSplitterSlowDimension::Pointer splitter = ImageRegionSplitterSlowDimension::New();
+  const unsigned int numberOfDivisions = splitter->GetNumberOfSplits(outputRegion,
+                                                                     this->GetStreamNumberOfDivisions(outputRegion));
+
+  itkDebugMacro(<< "Pipeline: " << m_Stages.size() << " stages, " << numberOfDivisions << " divisions" << std::endl)
+
+  for (unsigned int division = 0; division < numberOfDivisions; ++division)
+    {
+    OutputImageRegionType streamRegion = outputRegion;
+    splitter->GetSplit(division, numberOfDivisions, streamRegion);
+
+    // Each stage only computes (and allocates) the region requested by the next stage
+    lastOutput->SetRequestedRegion(streamRegion);
+    lastOutput->PropagateRequestedRegion();
+    lastOutput->UpdateOutputData();
+
+    ImageAlgorithm::Copy(lastOutput, output, streamRegion, streamRegion);
+
+    this->UpdateProgress(static_cast< float >(division + 1) / static_cast< float >(numberOfDivisions));
+    }
+
+  // Release the intermediate images
+  for (const StageType & stage : m_Stages)
+    {
+    stage.GetOutput()->ReleaseData();
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageFilterPipeline< TInputImage, TOutputImage >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Number of stages: " << m_Stages.size() << std::endl;
+  for (const StageType & stage : m_Stages)
+    {
+    os << indent.GetNextIndent() << stage.Filter->GetNameOfClass() << std::endl;
+    }
+  os << indent << "Number of stream divisions: " << m_NumberOfStreamDivisions << std::endl;
+  os << indent << "Stream cache size: "
+     << static_cast< typename NumericTraits< SizeValueType >::PrintType >( m_StreamCacheSize ) << std::endl;
+}
+
+}  //namespace itk
+
+#endif // itkTBBImageFilterPipeline_hxx
@@ -0,0 +1,128 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBImageRowSpans_h
+#define itkTBBImageRowSpans_h
+
+#include <itkImageRegion.h>
+
+#include <cstdint>
+#include <initializer_list>
+
+namespace itk
+{
+
+/**
+ * \class TBBImageRowSpans
+ *
+ * \brief Decomposes an image region into contiguous runs of pixels (row spans)
+ *
+ * A span is a pointer to the first pixel of a row of the region and a number of pixels,
+ * so a kernel can process it with a plain loop (auto-vectorized) or explicit SIMD.
+ * When the region covers whole rows of every buffer, the consecutive rows (slices, ...)
+ * are merged into a single span.
+ *
+ * \warning The spans address the buffer directly: only for itk::Image
+ * (not for itk::VectorImage or adaptors).
+ *
+ * \sa TBBUnaryFunctorImageFilter, TBBBinaryFunctorImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ */
+struct TBBImageRowSpans
+{
+  /** Largest alignment (in bytes) handled by GetRowAlignment(): a cache line */
+  static constexpr SizeValueType MaximumRowAlignment = 64;
+
+  /** Calls spanFunction(index, length) for each span of the region, where index is the
+   * index of the first pixel of the span and length its number of pixels.
+   * The spans are contiguous in all the buffered regions (the region must be inside them). */
+  template< unsigned int VDimension, typename TSpanFunction >
+  static void ForEachSpan(const ImageRegion< VDimension > & region,
+                          std::initializer_list< ImageRegion< VDimension > > bufferedRegions,
+                          TSpanFunction spanFunction)
+  {
+    if (region.GetNumberOfPixels() == 0)
+      {
+      return;
+      }
+
+    // Merge the next dimension while the previous ones cover whole rows of every buffer
+    unsigned int numberOfMergedDimensions = 1;
+    SizeValueType spanLength = region.GetSize(0);
+    while (numberOfMergedDimensions < VDimension)
+      {
+      bool wholeRows = true;
+      for (const ImageRegion< VDimension > & bufferedRegion : bufferedRegions)
+        {
+        wholeRows &= (region.GetSize(numberOfMergedDimensions - 1) ==
+                      bufferedRegion.GetSize(numberOfMergedDimensions - 1));
+        }
+      if (!wholeRows)
+        {
+        break;
+        }
+      spanLength *= region.GetSize(numberOfMergedDimensions);
+      ++numberOfMergedDimensions;
+      }
+
+    // Iterate over the remaining dimensions
+    typename ImageRegion< VDimension >::IndexType index = region.GetIndex();
+    while (true)
+      {
+      spanFunction(index, spanLength);
+
+      unsigned int dim = numberOfMergedDimensions;
+      for (; dim < VDimension; ++dim)
+        {
+        if (++index[dim] < region.GetIndex(dim) + static_cast< IndexValueType >(region.GetSize(dim)))
+          {
+          break;
+          }
+        index[dim] = region.GetIndex(dim);
+        }
+      if (dim == VDimension)
+        {
+        return;
+        }
+      }
+  }
+
+  /** Gets the alignment (in bytes, a power of two up to MaximumRowAlignment) of the first pixel
+   * of every row of the buffer: the largest power of two dividing both the address of the buffer
+   * and the size of a buffered row. The spans of the regions starting at the first buffered column
+   * have this alignment. */
+  template< typename TImage >
+  static SizeValueType GetRowAlignment(const TImage * image)
+  {
+    const std::uintptr_t address = reinterpret_cast< std::uintptr_t >(image->GetBufferPointer());
+    const SizeValueType rowSize = (TImage::ImageDimension > 1) ?
+      image->GetBufferedRegion().GetSize(0) * sizeof(typename TImage::InternalPixelType) : 0;
+
+    SizeValueType alignment = MaximumRowAlignment;
+    while (alignment > 1 && ((address % alignment) != 0 || (rowSize % alignment) != 0))
+      {
+      alignment /= 2;
+      }
+    return alignment;
+  }
+};
+
+} // end namespace itk
+
+#endif // itkTBBImageRowSpans_h
@@ -21,6 +21,20 @@
 
 #include <itkImageToImageFilter.h>
 
+#include <itkImage.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef ITK_USE_TBB
+#include "itkTBBTaskArenaPool.h"
+#include <tbb/partitioner.h>
+#else
+#include <atomic>
+#include <cstdint>
+#endif // ITK_USE_TBB
 
 namespace itk
 {
@@ -92,12 +106,59 @@ public:
   using JobIdType = unsigned int;
   /** Type to count the number of dimesions to separate the Jobs multithreading */
   using DimensionReductionType = int;
+  /** Type of the N-D tiles used to split the Jobs when UseTiles is On */
+  using TileSizeType = OutputImageSizeType;
+  /** Type of the cost model of the Jobs: approximate cost (in nanoseconds)
+   * to compute the output pixels of a region (see JobCostFunction) */
+  using JobCostFunctionType = std::function< double(const OutputImageRegionType &) >;
+  /** Type of the mask of the pixels to compute (see JobMask) */
+  using JobMaskImageType = Image< unsigned char, TOutputImage::ImageDimension >;
+#ifdef ITK_USE_TBB
+  /** Type of the TBB task arena executing the Jobs */
+  using TaskArenaPointer = TBBTaskArenaPool::TaskArenaPointer;
+#endif // ITK_USE_TBB
 
 
   // ImageDimension constants
   static constexpr unsigned int InputImageDimension = TInputImage::ImageDimension;
   static constexpr unsigned int OutputImageDimension = TOutputImage::ImageDimension;
   static constexpr unsigned int JobPerThreadRatio = 20;
+  /** Minimum cost (in nanoseconds) of the Jobs grouped in one TBB task
+   * when the GrainSize is automatic */
+  static constexpr unsigned int MinimumTaskCost = 50000;
+
+  /** Partitioner used to group the Jobs into TBB tasks */
+  enum PartitionerType
+    {
+    DefaultPartitioner = 0, // Chosen from GetPixelCost()
+    SimplePartitioner,      // Tasks of GrainSize Jobs
+    AutoPartitioner,        // Tasks of at least GrainSize Jobs, split on demand
+    AffinityPartitioner,    // As AutoPartitioner, replaying the job/thread mapping of the previous Update()
+    StaticPartitioner       // Jobs evenly distributed to the threads
+    };
+
+  /** Record of one TBBGenerateData() call (see RecordJobStatistics) */
+  struct JobRecordType
+    {
+    OutputImageRegionType Region; // Region of the (merged) jobs
+    double                Start;  // Start and end times, in seconds since the jobs were started
+    double                End;
+    unsigned int          Worker; // Index of the thread executing the jobs
+    };
+  using JobRecordContainerType = std::vector< JobRecordType >;
+
+  /** Summary of the jobs recorded during the last Update() */
+  struct JobStatisticsType
+    {
+    SizeValueType NumberOfJobs;    // Number of TBBGenerateData() calls
+    unsigned int  NumberOfWorkers; // Number of threads available to execute the jobs
+    double        TotalTime;       // Wall time of the parallel section (seconds)
+    double        TotalJobTime;    // Sum of the job times (seconds)
+    double        MaximumJobTime;
+    double        MeanJobTime;
+    double        ImbalanceRatio;  // Busy time of the busiest worker / mean busy time of the workers
+    double        IdleFraction;    // Fraction of the worker time not spent in the jobs
+    };
 
 public:
 
@@ -113,10 +174,110 @@ public:
    * nbReduceDim == 3  : Will generate 1500 Jobs with each voxel (size 1) */
   void SetNumberOfDimensionToReduce(DimensionReductionType NumberOfDimensionToReduce);
 
+  /** Set/Get whether the Jobs are N-D tiles (cache blocking) instead of
+   * slices/lines along the slowest dimensions (Off by default).
+   * When On, NumberOfDimensionToReduce is ignored. */
+  itkSetMacro(UseTiles, bool);
+  itkGetConstMacro(UseTiles, bool);
+  itkBooleanMacro(UseTiles);
+
+  /** Set/Get the size of the tiles used when UseTiles is On.
+   * A null component is derived automatically so that a tile fits in TileCacheSize.
+   * \example : for a 3D image (volume) with the shape 512x512x512
+   * TileSize == 64x16x8 : Will generate 8x32x64 Jobs with the tiles (size 64x16x8)
+   * TileSize == 0x0x0   : Will generate tiles of (input + output) TileCacheSize bytes */
+  itkSetMacro(TileSize, TileSizeType);
+  itkGetConstReferenceMacro(TileSize, TileSizeType);
+
+  /** Set/Get the number of bytes (input + output pixels) an automatic tile should fit in.
+   * (default: 256 KiB, the size of a typical L2 cache) */
+  itkSetMacro(TileCacheSize, SizeValueType);
+  itkGetConstMacro(TileCacheSize, SizeValueType);
+
+  /** Set/Get the number of consecutive Jobs processed together.
+   * Consecutive Jobs are merged into a single region before calling TBBGenerateData().
+   * (GrainSize == 0 : automatic, based on GetPixelCost() and MinimumTaskCost) */
+  itkSetMacro(GrainSize, JobIdType);
+  itkGetConstMacro(GrainSize, JobIdType);
+
+  /** Set/Get the TBB partitioner (DefaultPartitioner by default).
+   * Without TBB, only the GrainSize is used: the threads claim GrainSize Jobs at once.
+   * (ignored when ParallelFirstTouch is On) */
+  itkSetMacro(Partitioner, PartitionerType);
+  itkGetConstMacro(Partitioner, PartitionerType);
+
+  /** Set/Get whether the pages of the output are first touched in parallel (Off by default).
+   * When On, the output is initialized with the same Jobs as TBBGenerateData() before
+   * BeforeThreadedGenerateData(), so on NUMA machines each page is mapped on the node
+   * of the thread initializing it. The Jobs are then executed with the AffinityPartitioner,
+   * replaying the job/thread mapping of the initialization (and of the previous Update()).
+   * Without TBB, the chunks of GrainSize Jobs are statically mapped to the threads instead
+   * of being claimed. This costs an additional pass writing the output.
+   * \warning When On, BeforeThreadedGenerateData() is called after the Jobs are generated:
+   *          the decomposition settings it changes are only used by the next Update().
+   *          When Off, it is called before (as with ImageToImageFilter). */
+  itkSetMacro(ParallelFirstTouch, bool);
+  itkGetConstMacro(ParallelFirstTouch, bool);
+  itkBooleanMacro(ParallelFirstTouch);
+
+  /** Set/Get the cost model of the Jobs (null by default).
+   * When a JobCostFunction or a JobMask is set, the Jobs of the usual decomposition
+   * (slices/lines or tiles) are weighted by their cost before the scheduling:
+   * - the Jobs of null cost are not computed, FillSkippedOutput() initializes their output;
+   * - the consecutive cheap Jobs are grouped, and the expensive Jobs are split, into Jobs
+   *   of about the total cost / (JobPerThreadRatio * NumberOfThreads), and at least MinimumTaskCost.
+   * The function is called once per Job of the usual decomposition (concurrently with TBB):
+   * reduce more dimensions, or use smaller tiles, to skip the empty regions more finely.
+   * The JobCostFunction has precedence over the JobMask. */
+  void SetJobCostFunction(const JobCostFunctionType & costFunction);
+  const JobCostFunctionType & GetJobCostFunction() const;
+
+  /** Set/Get the mask of the pixels to compute (optional input, same grid as the output).
+   * The cost of a Job is its number of non-zero mask pixels times GetPixelCost(),
+   * so the Jobs outside the mask are skipped (see JobCostFunction). */
+  itkSetInputMacro(JobMask, JobMaskImageType);
+  itkGetInputMacro(JobMask, JobMaskImageType);
+
   // redefinition so we can use our own member if ITK_USE_TBB is defined
+  // With TBB, the number of threads is the concurrency of the task arena
+  // (0 : default TBB concurrency).
   const ThreadIdType & GetNumberOfThreads() const override;
   void SetNumberOfThreads(ThreadIdType) override;
 
+  /** Set/Get whether the region, start/end time and worker of each TBBGenerateData() call
+   * are recorded (Off by default). The recording adds two clock reads per call, and the jobs
+   * are not timed at all when it is Off. */
+  itkSetMacro(RecordJobStatistics, bool);
+  itkGetConstMacro(RecordJobStatistics, bool);
+  itkBooleanMacro(RecordJobStatistics);
+
+  /** Gets the jobs recorded during the last Update(), sorted by start time */
+  const JobRecordContainerType & GetJobRecords() const;
+
+  /** Gets the summary of the jobs recorded during the last Update() */
+  const JobStatisticsType & GetJobStatistics() const;
+
+  /** Gets the number of Jobs scheduled during the last Update() */
+  itkGetConstMacro( NumberOfJobs, JobIdType );
+
+  /** Gets the approximate cost (in nanoseconds) of the requested region of the last Update():
+   * its number of pixels times GetPixelCost() (see TBBImageFilterBatch) */
+  double GetJobDecompositionCost() const;
+
+  /** Writes the jobs recorded during the last Update() as a Chrome trace_event JSON file
+   * (one row per worker in chrome://tracing or https://ui.perfetto.dev).
+   * \exception Thrown if the file cannot be written. */
+  void WriteJobTrace(const std::string & fileName) const;
+
+#ifdef ITK_USE_TBB
+  /** Set/Get the TBB task arena executing the Jobs.
+   * By default, the arena is shared by all the filters with the same number of threads
+   * (see TBBTaskArenaPool). Setting an arena sets the number of threads to its concurrency;
+   * setting the number of threads switches back to the shared arena. */
+  void SetTaskArena(const TaskArenaPointer & taskArena);
+  TaskArenaPointer GetTaskArena() const;
+#endif // ITK_USE_TBB
+
 
 protected:
   TBBImageToImageFilter();
@@ -141,8 +302,7 @@ protected:
   void GenerateData() override;
 
 
-  /** Set/Get the number of jobs (Internal). */
-  itkGetConstMacro( NumberOfJobs, JobIdType );
+  /** Set the number of jobs (Internal). */
   itkSetMacro( NumberOfJobs, JobIdType );
 
   /** Generate the number Jobs based on the NbReduceDimensions
@@ -151,16 +311,89 @@ protected:
    * \warning  This function must be called after the NumberOfThreads is set. */
   void GenerateNumberOfJobs();
 
-#ifndef ITK_USE_TBB
-  /** Gets the next job.*/
-  int GetNextJob();
+  /** Gets the number of threads executing the Jobs: the NumberOfThreads, or the concurrency
+   * of the task arena when the NumberOfThreads is 0 (automatic, which is kept). */
+  ThreadIdType GetJobNumberOfThreads() const;
+
+  /** Splits the requested region into the sections decomposed into Jobs
+   * (default: a single section, the requested region).
+   * The Jobs of a section are numbered before the Jobs of the next section, and the Jobs of
+   * two sections are never merged into one region. All the sections use the same Job size.
+   * The sections must not overlap and must cover the requested region (empty sections are ignored).
+   * \warning  This function is called by GenerateNumberOfJobs(), after the inputs are updated. */
+  virtual void GenerateJobSections(const OutputImageRegionType & requestedRegion,
+                                   std::vector< OutputImageRegionType > & sections);
+
+  /** Gets the output region of the job jobId of the usual decomposition
+   * (before the weighting by the JobCostFunction or the JobMask).
+   * \warning  This function must be called after GenerateNumberOfJobs(). */
+  OutputImageRegionType GetJobRegion(JobIdType jobId) const;
+
+  /** Merges the consecutive jobs starting at jobBegin (and before jobEnd)
+   * into the largest contiguous output region, and returns the number of merged jobs.
+   * \warning  This function must be called after GenerateNumberOfJobs(). */
+  JobIdType GetJobRangeRegion(JobIdType jobBegin, JobIdType jobEnd, OutputImageRegionType& region) const;
+
+  /** Approximate cost (in nanoseconds) to compute one output pixel.
+   * Subclasses can override this hint to tune the automatic GrainSize and Partitioner:
+   * cheap pixels lead to groups of Jobs, expensive pixels to one Job per task.
+   * (default: 1 ns, a simple pointwise operation) */
+  virtual double GetPixelCost() const;
+
+  /** Gets the GrainSize and the Partitioner used for the current decomposition
+   * (resolves the automatic settings).
+   * \warning  These functions must be called after GenerateNumberOfJobs(). */
+  JobIdType GetJobGrainSize() const;
+  PartitionerType GetJobPartitioner() const;
+
+  /** Groups and splits the Jobs by cost, and skips the Jobs of null cost
+   * (Internal, see JobCostFunction). Called by GenerateNumberOfJobs(). */
+  void GenerateWeightedJobs();
+
+  /** Gets the cost of a region from the JobCostFunction, or from the JobMask (Internal). */
+  double GetJobCost(const OutputImageRegionType & region) const;
+
+  /** Executes the jobs [jobBegin, jobEnd[, merged into contiguous regions. */
+  void ExecuteJobs(JobIdType jobBegin, JobIdType jobEnd);
+
+  /** Calls TBBGenerateData() (or FillSkippedOutput() for a skipped Job), and records the call
+   * when RecordJobStatistics is On, or FirstTouchOutput() during the first touch pass (Internal). */
+  void GenerateJobData(const OutputImageRegionType& region, bool skipped = false);
+
+  /** Initializes the output region of a Job (first touch pass, see ParallelFirstTouch).
+   * (default: fills the region with zeros) */
+  virtual void FirstTouchOutput(const OutputImageRegionType& region);
+
+  /** Initializes the output region of a Job of null cost, not computed by TBBGenerateData()
+   * (see JobCostFunction). (default: fills the region with zeros) */
+  virtual void FillSkippedOutput(const OutputImageRegionType& region);
+
+  /** Gets the index of the thread executing the current job (Internal). */
+  unsigned int GetJobWorker() const;
+
+  /** Compute the size of the tiles (Internal).
+   * Derives the null components of TileSize from TileCacheSize and the NumberOfThreads. */
+  void GenerateTileSize();
+
+  /** Set/Get whether the Jobs always contain whole rows of the requested region
+   * (Off by default). When On, the fastest dimension is never split: the slices/lines
+   * stop at the lines, and the tiles span whole rows. Subclasses processing contiguous
+   * rows (see TBBUnaryFunctorImageFilter) turn it On in their constructor. */
+  itkSetMacro(KeepWholeRows, bool);
+  itkGetConstMacro(KeepWholeRows, bool);
 
-  /** Executes the job identified by jobId. */
-  void ExecuteJob( int jobId );
+#ifndef ITK_USE_TBB
+  /** Claims the next chunk of jobs [jobBegin, jobEnd[ without locking (chunks of the job
+   * grain size, clamped to [1, NumberOfJobs]). Returns false when the job queue is empty. */
+  bool GetNextJobs(JobIdType& jobBegin, JobIdType& jobEnd);
 
-  /** Reset the job queu index to 0.*/
+  /** Reset the job queu index to 0, and computes the chunk size.*/
   void ResetJobQueue();
 
+  /** Gets the id of the MultiThreader thread executing the current job
+   * (in [0, NumberOfThreads[), to keep per-thread data without locking. */
+  static ThreadIdType GetJobThreadId();
+
   /** Internal function. Callback method for the multithreader.
    *
    * \exception Thrown an exception if an error occurs.
@@ -173,13 +406,75 @@ protected:
 private:
   JobIdType                   m_NumberOfJobs;
   DimensionReductionType      m_NumberOfDimensionToReduce;
+  bool                        m_UseTiles;
+  bool                        m_KeepWholeRows;
+  TileSizeType                m_TileSize;
+  SizeValueType               m_TileCacheSize;
+  JobIdType                   m_GrainSize;
+  PartitionerType             m_Partitioner;
+  bool                        m_ParallelFirstTouch;
+  bool                        m_FirstTouchPass;
+
+  // Sets m_FirstTouchPass during the first touch pass, and resets it even if the pass throws
+  struct FirstTouchPassGuard
+    {
+    explicit FirstTouchPassGuard(bool & firstTouchPass): FirstTouchPass(firstTouchPass) { FirstTouchPass = true; }
+    ~FirstTouchPassGuard() { FirstTouchPass = false; }
+    bool & FirstTouchPass;
+    };
+
+  // Job recording: each worker appends to its own container during the parallel section
+  bool                                    m_RecordJobStatistics;
+  std::vector< JobRecordContainerType >   m_WorkerJobRecords;
+  std::chrono::steady_clock::time_point   m_JobTimeOrigin;
+  JobRecordContainerType                  m_JobRecords;
+  JobStatisticsType                       m_JobStatistics;
+
+  void BeginJobRecording(unsigned int numberOfWorkers);
+  void EndJobRecording();
+
+  void FillOutputRegion(const OutputImageRegionType & region, const OutputImagePixelType & value);
+
+  // Job decomposition of the requested region, computed by GenerateNumberOfJobs()
+  struct JobSectionType
+    {
+    OutputImageRegionType Region;
+    OutputImageSizeType   NumberOfJobsPerDimension;
+    JobIdType             FirstJob;
+    JobIdType             NumberOfJobs;
+    };
+  OutputImageRegionType         m_JobDecompositionRegion;
+  OutputImageSizeType           m_JobSize;
+  std::vector< JobSectionType > m_JobSections;
+
+  // Cost-weighted Jobs (empty without cost model): the scheduled Job i is m_WeightedJobs[i]
+  struct WeightedJobType
+    {
+    JobIdType    FirstJob;       // The Jobs [FirstJob, EndJob[ of the usual decomposition,
+    JobIdType    EndJob;
+    unsigned int Piece;          // or the piece Piece/NumberOfPieces of the Job FirstJob,
+    unsigned int NumberOfPieces; // split along SplitDimension
+    unsigned int SplitDimension;
+    bool         Skipped;        // Null cost: FillSkippedOutput() instead of TBBGenerateData()
+    };
+  JobCostFunctionType            m_JobCostFunction;
+  std::vector< WeightedJobType > m_WeightedJobs;
 
 #ifndef ITK_USE_TBB
-  int                         m_CurrentJobQueueIndex;
-  itk::SimpleFastMutexLock    m_JobQueueMutex;
+  // Next job to claim, and number of jobs claimed at once (set once per Update()).
+  // The index is 64 bits: each thread increments it past the last job before stopping.
+  std::atomic< std::uint64_t > m_CurrentJobQueueIndex;
+  JobIdType                   m_JobQueueChunkSize;
+
+  // Id of the MultiThreader thread, set by MyThreaderCallback() in each thread.
+  static ThreadIdType & GetJobThreadIdReference();
 #else
   // Use to ensure that the number of thread can't be modify by one of the classs inherited.
   ThreadIdType                m_TBBNumberOfThreads;
+  // Injected task arena (null : shared arena of m_TBBNumberOfThreads).
+  TaskArenaPointer            m_TaskArena;
+  // Keeps the job/thread mapping between two Update() for the AffinityPartitioner.
+  tbb::affinity_partitioner   m_AffinityPartitioner;
 #endif // ITK_USE_TBB
 
 };
@@ -213,24 +508,20 @@ public:
   using Self = TBBFunctor;
   using OutputImageType = TOutputImage;
   using OutputImageConstPointer = typename OutputImageType::ConstPointer;
-  using OutputImageSizeType = typename TOutputImage::SizeType;
   using OutputImageRegionType = typename OutputImageType::RegionType;
 
-  static constexpr unsigned int InputImageDimension = TInputImage::ImageDimension;
-  static constexpr unsigned int OutputImageDimension = TOutputImage::ImageDimension;
-
   using TbbImageFilterType = itk::TBBImageToImageFilter<TInputImage,TOutputImage>;
+  using JobIdType = typename TbbImageFilterType::JobIdType;
 
-  TBBFunctor(TbbImageFilterType *tbbFilter, const OutputImageSizeType& outputSize):
-    m_TBBFilter(tbbFilter), m_OutputSize(outputSize)
+  TBBFunctor(TbbImageFilterType *tbbFilter):
+    m_TBBFilter(tbbFilter)
   {
   }
 
-  void operator() ( const tbb::blocked_range<int>& r ) const;
+  void operator() ( const tbb::blocked_range<JobIdType>& r ) const;
 
 private:
   TbbImageFilterType *m_TBBFilter;
-  OutputImageSizeType m_OutputSize;
 };
 
 } // itk
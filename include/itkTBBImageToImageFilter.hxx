@@ -22,25 +22,45 @@
 #include "itkTBBImageToImageFilter.h"
 
 #include "itkImageSource.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
 #include "itkImageRegionSplitterBase.h"
 #include "itkOutputDataObjectIterator.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+
 #ifdef ITK_USE_TBB
 #include <tbb/parallel_for.h>
-#include <tbb/task_scheduler_init.h>
-#include <tbb/compat/thread>
-#include <tbb/tick_count.h>
+#include <tbb/task_arena.h>
 #endif // ITK_USE_TBB
 
 namespace itk
 {
 
 template< typename TInputImage, typename TOutputImage >
-TBBImageToImageFilter< TInputImage, TOutputImage >::TBBImageToImageFilter()
+TBBImageToImageFilter< TInputImage, TOutputImage >::TBBImageToImageFilter():
+  m_NumberOfJobs(0),
+  m_UseTiles(false),
+  m_KeepWholeRows(false),
+  m_TileCacheSize(256 * 1024),
+  m_GrainSize(0),
+  m_Partitioner(DefaultPartitioner),
+  m_ParallelFirstTouch(false),
+  m_FirstTouchPass(false),
+  m_RecordJobStatistics(false)
 {
   // By default, Automatic NbReduceDimensions
   this->SetNumberOfDimensionToReduce(-1);
 
+  // By default, Automatic tile size (when UseTiles is On)
+  m_TileSize.Fill(0);
+  m_JobSize.Fill(0);
+  m_JobStatistics = JobStatisticsType();
+
   // We d'ont need itk::barrier, itk::MultiThreader::SingleMethodeExecute
   // is already taking care of that job, (using itk::MultiThreader::WaitForSingleMethodThread)
 
@@ -48,6 +68,9 @@ TBBImageToImageFilter< TInputImage, TOutputImage >::TBBImageToImageFilter()
   // By default, do not define the number of threads.
   // Let TBB doing that.
   this->SetNumberOfThreads(0);
+#else
+  m_CurrentJobQueueIndex = 0;
+  m_JobQueueChunkSize = 1;
 #endif // ITK_USE_TBB
 }
 
@@ -59,30 +82,22 @@ TBBImageToImageFilter< TInputImage, TOutputImage >::~TBBImageToImageFilter()
 template< typename TInputImage, typename TOutputImage >
 void TBBImageToImageFilter< TInputImage, TOutputImage >::GenerateData()
 {
-  // Get the size of the requested region
-  typename TOutputImage::ConstPointer output = static_cast<TOutputImage *>(this->ProcessObject::GetOutput(0));
-
   // Call a method that can be overriden by a subclass to allocate
   // memory for the filter's outputs
   this->AllocateOutputs();
 
   // Call a method that can be overridden by a subclass to perform
   // some calculations prior to splitting the main computations into
-  // separate threads
-  this->BeforeThreadedGenerateData();
-
-#ifdef ITK_USE_TBB
-  typename TOutputImage::SizeType outputSize = output->GetRequestedRegion().GetSize();
-
-  // Set up the number of threads with default
-  // if it was not previously set
-  if (this->GetNumberOfThreads() <= 0)
+  // separate threads (after the first touch pass when ParallelFirstTouch is On)
+  if (!m_ParallelFirstTouch)
     {
-    this->SetNumberOfThreads(tbb::task_scheduler_init::default_num_threads());
+    this->BeforeThreadedGenerateData();
     }
 
-  // Set up the TBB task_scheduler
-  tbb::task_scheduler_init tbb_init(this->GetNumberOfThreads());
+#ifdef ITK_USE_TBB
+  // Get the long-lived task arena (set up once, shared between the Update() calls).
+  // With the automatic NumberOfThreads (0), the Jobs are decomposed for its concurrency.
+  const TaskArenaPointer taskArena = this->GetTaskArena();
 
   // Generate the number of Jobs
   // based on the OutputImageDimension, NumberOfThreads and NbReduceDimensions
@@ -90,27 +105,73 @@ void TBBImageToImageFilter< TInputImage, TOutputImage >::GenerateData()
 
   // Debug Output
   itkDebugMacro(<< "TBB: " << this->GetNumberOfJobs() << "jobs, "
-                << this->GetNumberOfThreads() << "threads;" << std::endl)
+                << this->GetJobNumberOfThreads() << "threads, "
+                << this->GetJobGrainSize() << "grain size;" << std::endl)
 
-      // Do the task decomposition using parallel_for
-      tbb::parallel_for(
-        tbb::blocked_range<int>(0, this->GetNumberOfJobs()),
-        TBBFunctor<TInputImage, TOutputImage>(this, outputSize),
-        tbb::simple_partitioner()); // force size 1 step
+  const tbb::blocked_range<JobIdType> jobRange(0, this->GetNumberOfJobs(), this->GetJobGrainSize());
+  const TBBFunctor<TInputImage, TOutputImage> tbbFunctor(this);
+  if (m_ParallelFirstTouch)
+    {
+    // Each worker first touches the pages of its Jobs
+    // (the affinity partitioner records the mapping for the Jobs)
+    {
+    const FirstTouchPassGuard firstTouchPass(m_FirstTouchPass);
+    taskArena->execute([&]
+      {
+      tbb::parallel_for(jobRange, tbbFunctor, m_AffinityPartitioner);
+      });
+    }
+    this->BeforeThreadedGenerateData();
+    }
+
+  // Do the task decomposition using parallel_for, in the task arena
+  const PartitionerType partitioner = this->GetJobPartitioner();
+  this->BeginJobRecording(static_cast< unsigned int >(taskArena->max_concurrency()));
+  taskArena->execute([&]
+    {
+    switch (partitioner)
+      {
+      case AutoPartitioner:
+        tbb::parallel_for(jobRange, tbbFunctor, tbb::auto_partitioner());
+        break;
+      case AffinityPartitioner:
+        tbb::parallel_for(jobRange, tbbFunctor, m_AffinityPartitioner);
+        break;
+      case StaticPartitioner:
+        tbb::parallel_for(jobRange, tbbFunctor, tbb::static_partitioner());
+        break;
+      default:
+        tbb::parallel_for(jobRange, tbbFunctor, tbb::simple_partitioner());
+        break;
+      }
+    });
+  this->EndJobRecording();
 #else
   // Generate the number of Jobs
   // based on the OutputImageDimension, NumberOfThreads and NbReduceDimensions
   this->GenerateNumberOfJobs();
 
-  // Reinitialize current job index
+  // Reinitialize current job index, and the number of jobs claimed at once
   this->ResetJobQueue();
 
   // Set up the multithreaded processing
   this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
   this->GetMultiThreader()->SetSingleMethod(this->MyThreaderCallback, (void *)this );
 
+  if (m_ParallelFirstTouch)
+    {
+    // Each thread first touches the pages of its Jobs (same static mapping as the Jobs)
+    {
+    const FirstTouchPassGuard firstTouchPass(m_FirstTouchPass);
+    this->GetMultiThreader()->SingleMethodExecute();
+    }
+    this->BeforeThreadedGenerateData();
+    }
+
   // multithread the execution
+  this->BeginJobRecording(this->GetMultiThreader()->GetNumberOfThreads());
   this->GetMultiThreader()->SingleMethodExecute();
+  this->EndJobRecording();
 #endif // ITK_USE_TBB
 
   // Call a method that can be overridden by a subclass to perform
@@ -129,16 +190,69 @@ const ThreadIdType & TBBImageToImageFilter< TInputImage, TOutputImage >::GetNumb
 
 }
 
+template< typename TInputImage, typename TOutputImage >
+ThreadIdType TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobNumberOfThreads() const
+{
+#ifdef ITK_USE_TBB
+  if (m_TBBNumberOfThreads > 0)
+    {
+    return m_TBBNumberOfThreads;
+    }
+  return static_cast< ThreadIdType >(this->GetTaskArena()->max_concurrency());
+#else
+  return std::max< ThreadIdType >(1, this->GetNumberOfThreads());
+#endif // ITK_USE_TBB
+}
+
 template< typename TInputImage, typename TOutputImage >
 void TBBImageToImageFilter< TInputImage, TOutputImage >::SetNumberOfThreads(ThreadIdType nbThreads)
 {
 #ifdef ITK_USE_TBB
   this->m_TBBNumberOfThreads = nbThreads;
+  this->m_TaskArena.reset();
 #else
   Superclass::SetNumberOfThreads(nbThreads);
 #endif // ITK_USE_TBB
 }
 
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::SetJobCostFunction(const JobCostFunctionType & costFunction)
+{
+  m_JobCostFunction = costFunction;
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage >
+const typename TBBImageToImageFilter< TInputImage, TOutputImage >::JobCostFunctionType &
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobCostFunction() const
+{
+  return m_JobCostFunction;
+}
+
+#ifdef ITK_USE_TBB
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::SetTaskArena(const TaskArenaPointer & taskArena)
+{
+  if (taskArena)
+    {
+    taskArena->initialize();
+    this->m_TBBNumberOfThreads = static_cast< ThreadIdType >(taskArena->max_concurrency());
+    }
+  this->m_TaskArena = taskArena;
+}
+
+template< typename TInputImage, typename TOutputImage >
+typename TBBImageToImageFilter< TInputImage, TOutputImage >::TaskArenaPointer
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetTaskArena() const
+{
+  if (m_TaskArena)
+    {
+    return m_TaskArena;
+    }
+  return TBBTaskArenaPool::GetTaskArena(static_cast< int >(m_TBBNumberOfThreads));
+}
+#endif // ITK_USE_TBB
+
 template< typename TInputImage, typename TOutputImage >
 void TBBImageToImageFilter< TInputImage, TOutputImage >::
 SetNumberOfDimensionToReduce(DimensionReductionType NumberOfDimensionToReduce)
@@ -156,37 +270,575 @@ SetNumberOfDimensionToReduce(DimensionReductionType NumberOfDimensionToReduce)
 template< typename TInputImage, typename TOutputImage >
 void TBBImageToImageFilter< TInputImage, TOutputImage >::GenerateNumberOfJobs()
 {
-  // Get the size of the requested region
+  // Get the requested region
   typename TOutputImage::ConstPointer output = static_cast<TOutputImage *>(this->ProcessObject::GetOutput(0));
-  typename TOutputImage::SizeType outputSize = output->GetRequestedRegion().GetSize();
+  m_JobDecompositionRegion = output->GetRequestedRegion();
+  const OutputImageSizeType & outputSize = m_JobDecompositionRegion.GetSize();
+
+  if (m_UseTiles)
+    {
+    this->GenerateTileSize();
+    }
+  else
+    {
+    // The fastest dimension is only split when the Jobs may cut the rows
+    const int maxNumberOfDimensionToReduce = static_cast<int>(OutputImageDimension) -
+      ((m_KeepWholeRows && OutputImageDimension > 1) ? 1 : 0);
+
+    if (m_NumberOfDimensionToReduce < 0)
+      {
+      // Heuristic NbReduceDimensions
+      m_NumberOfDimensionToReduce = 0;
+      SizeValueType nbJobs = 1;
+      int current_dim = OutputImageDimension-1;
+
+      // Minimum Number of Jobs, based on the Number of thread
+      unsigned int minNbJobs = JobPerThreadRatio * this->GetJobNumberOfThreads();
+      while( m_NumberOfDimensionToReduce < maxNumberOfDimensionToReduce && nbJobs < minNbJobs )
+        {
+        ++m_NumberOfDimensionToReduce;
+        nbJobs *= outputSize[current_dim];
+        --current_dim;
+        }
+      }
+
+    // A slice/line job is a tile with the full size along the non-reduced dimensions
+    const unsigned int firstReducedDim = OutputImageDimension -
+      std::min(GetNumberOfDimensionToReduce(), maxNumberOfDimensionToReduce);
+    for (unsigned int i = 0; i < OutputImageDimension; ++i)
+      {
+      m_JobSize[i] = (i < firstReducedDim) ? outputSize[i] : 1;
+      }
+    }
+
+  for (unsigned int i = 0; i < OutputImageDimension; ++i)
+    {
+    m_JobSize[i] = std::max< SizeValueType >(m_JobSize[i], 1);
+    }
+
+  // Number of jobs along each dimension of each section (the last job of a dimension may be smaller)
+  std::vector< OutputImageRegionType > sectionRegions;
+  this->GenerateJobSections(m_JobDecompositionRegion, sectionRegions);
+  m_JobSections.clear();
+  m_NumberOfJobs = 0;
+  for (const OutputImageRegionType & sectionRegion : sectionRegions)
+    {
+    if (sectionRegion.GetNumberOfPixels() == 0)
+      {
+      continue;
+      }
+    JobSectionType section;
+    section.Region = sectionRegion;
+    section.FirstJob = m_NumberOfJobs;
+    section.NumberOfJobs = 1;
+    for (unsigned int i = 0; i < OutputImageDimension; ++i)
+      {
+      section.NumberOfJobsPerDimension[i] = (sectionRegion.GetSize(i) + m_JobSize[i] - 1) / m_JobSize[i];
+      section.NumberOfJobs *= section.NumberOfJobsPerDimension[i];
+      }
+    m_NumberOfJobs += section.NumberOfJobs;
+    m_JobSections.push_back(section);
+    }
 
-  // Generate the number of job
-  if (m_NumberOfDimensionToReduce < 0)
+  this->GenerateWeightedJobs();
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::GenerateWeightedJobs()
+{
+  m_WeightedJobs.clear();
+  if (!m_JobCostFunction && !this->GetJobMask())
+    {
+    return;
+    }
+  if (!m_JobCostFunction && !this->GetJobMask()->GetBufferedRegion().IsInside(m_JobDecompositionRegion))
+    {
+    itkExceptionMacro(<< "The buffered region of the job mask " << this->GetJobMask()->GetBufferedRegion()
+                      << " does not contain the requested region " << m_JobDecompositionRegion);
+    }
+
+  // Cost of each Job of the usual decomposition
+  const JobIdType numberOfJobs = m_NumberOfJobs;
+  std::vector< double > jobCosts(numberOfJobs);
+  const auto computeJobCosts = [this, &jobCosts](JobIdType jobBegin, JobIdType jobEnd)
+    {
+    for (JobIdType jobId = jobBegin; jobId < jobEnd; ++jobId)
+      {
+      jobCosts[jobId] = std::max(0.0, this->GetJobCost(this->GetJobRegion(jobId)));
+      }
+    };
+#ifdef ITK_USE_TBB
+  this->GetTaskArena()->execute([&]
+    {
+    tbb::parallel_for(tbb::blocked_range< JobIdType >(0, numberOfJobs),
+                      [&](const tbb::blocked_range< JobIdType > & r) { computeJobCosts(r.begin(), r.end()); });
+    });
+#else
+  computeJobCosts(0, numberOfJobs);
+#endif // ITK_USE_TBB
+
+  // Each weighted Job costs about targetCost. The skipped Jobs only write their output,
+  // they are grouped by the same rule, with a cost of a fraction of nanosecond per pixel.
+  const double totalCost = std::accumulate(jobCosts.begin(), jobCosts.end(), 0.0);
+  const double targetCost = std::max< double >(MinimumTaskCost,
+    totalCost / (JobPerThreadRatio * this->GetJobNumberOfThreads()));
+  const double skippedPixelCost = 0.25;
+  const unsigned int firstSplitDimension = (m_KeepWholeRows && OutputImageDimension > 1) ? 1 : 0;
+
+  std::vector< WeightedJobType > skippedJobs;
+  for (const JobSectionType & section : m_JobSections)
+    {
+    const JobIdType sectionEnd = section.FirstJob + section.NumberOfJobs;
+    for (JobIdType jobId = section.FirstJob; jobId < sectionEnd; )
+      {
+      const bool skipped = (jobCosts[jobId] <= 0.0);
+      const auto getCost = [&](JobIdType id)
+        {
+        return skipped ? skippedPixelCost * this->GetJobRegion(id).GetNumberOfPixels() : jobCosts[id];
+        };
+      WeightedJobType job = { jobId, jobId + 1, 0, 1, 0, skipped };
+      double cost = getCost(jobId);
+
+      // Expensive Job: split into pieces along its slowest dimension (the cost is assumed uniform)
+      if (!skipped && cost > targetCost)
+        {
+        const OutputImageRegionType jobRegion = this->GetJobRegion(jobId);
+        for (int i = OutputImageDimension - 1; i >= static_cast< int >(firstSplitDimension); --i)
+          {
+          if (jobRegion.GetSize(i) > 1)
+            {
+            job.SplitDimension = static_cast< unsigned int >(i);
+            job.NumberOfPieces = static_cast< unsigned int >(std::min< double >(jobRegion.GetSize(i),
+              std::ceil(cost / targetCost)));
+            break;
+            }
+          }
+        for (job.Piece = 0; job.Piece < job.NumberOfPieces; ++job.Piece)
+          {
+          m_WeightedJobs.push_back(job);
+          }
+        ++jobId;
+        continue;
+        }
+
+      // Cheap Jobs: group the next Jobs of the same kind while the group costs less than the target
+      for (++jobId; jobId < sectionEnd && (jobCosts[jobId] <= 0.0) == skipped; ++jobId)
+        {
+        const double nextCost = getCost(jobId);
+        if (cost + nextCost > targetCost)
+          {
+          break;
+          }
+        cost += nextCost;
+        }
+      job.EndJob = jobId;
+      (skipped ? skippedJobs : m_WeightedJobs).push_back(job);
+      }
+    }
+
+  // The skipped Jobs last: they are cheap, and fill the gaps at the end
+  m_WeightedJobs.insert(m_WeightedJobs.end(), skippedJobs.begin(), skippedJobs.end());
+  m_NumberOfJobs = static_cast< JobIdType >(m_WeightedJobs.size());
+}
+
+template< typename TInputImage, typename TOutputImage >
+double TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobCost(const OutputImageRegionType & region) const
+{
+  if (m_JobCostFunction)
+    {
+    return m_JobCostFunction(region);
+    }
+
+  SizeValueType numberOfMaskPixels = 0;
+  ImageRegionConstIterator< JobMaskImageType > it(this->GetJobMask(), region);
+  for (; !it.IsAtEnd(); ++it)
+    {
+    if (it.Get())
+      {
+      ++numberOfMaskPixels;
+      }
+    }
+  return this->GetPixelCost() * numberOfMaskPixels;
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::
+GenerateJobSections(const OutputImageRegionType & requestedRegion, std::vector< OutputImageRegionType > & sections)
+{
+  sections.assign(1, requestedRegion);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::GenerateTileSize()
+{
+  const OutputImageSizeType & outputSize = m_JobDecompositionRegion.GetSize();
+
+  // Fixed components are used as is, null components start at the full size
+  bool automatic[OutputImageDimension];
+  SizeValueType tileNumberOfPixels = 1;
+  for (unsigned int i = 0; i < OutputImageDimension; ++i)
     {
-    // assert (GetNumberOfThreads()>0)
-    // This function must be called after the NumberOfThreads is Set
+    automatic[i] = (m_TileSize[i] == 0);
+    m_JobSize[i] = std::max< SizeValueType >(1,
+      automatic[i] ? outputSize[i] : std::min(m_TileSize[i], outputSize[i]));
+    if (i == 0 && m_KeepWholeRows && OutputImageDimension > 1)
+      {
+      automatic[i] = false;
+      m_JobSize[i] = std::max< SizeValueType >(1, outputSize[i]);
+      }
+    tileNumberOfPixels *= m_JobSize[i];
+    }
+
+  // Halve the largest automatic dimension until the tile fits in the cache
+  // and there is at least one tile per thread.
+  // The fastest dimension is favored (x4) to keep long contiguous rows.
+  const SizeValueType pixelSize = sizeof(InputImagePixelType) + sizeof(OutputImagePixelType);
+  const SizeValueType maxTileNumberOfPixels = std::max< SizeValueType >(1, m_TileCacheSize / pixelSize);
+  const SizeValueType minNbJobs = this->GetJobNumberOfThreads();
+  SizeValueType nbJobs = m_JobDecompositionRegion.GetNumberOfPixels() / std::max< SizeValueType >(1, tileNumberOfPixels);
+  while (tileNumberOfPixels > maxTileNumberOfPixels || nbJobs < minNbJobs)
+    {
+    int splitDim = -1;
+    SizeValueType splitExtent = 1;
+    for (int i = OutputImageDimension - 1; i >= 0; --i)
+      {
+      const SizeValueType extent = (i == 0) ? m_JobSize[i] / 4 : m_JobSize[i];
+      if (automatic[i] && m_JobSize[i] > 1 && extent >= splitExtent)
+        {
+        splitDim = i;
+        splitExtent = extent;
+        }
+      }
+    if (splitDim < 0)
+      {
+      break;
+      }
+    tileNumberOfPixels /= m_JobSize[splitDim];
+    m_JobSize[splitDim] = (m_JobSize[splitDim] + 1) / 2;
+    tileNumberOfPixels *= m_JobSize[splitDim];
+    nbJobs = m_JobDecompositionRegion.GetNumberOfPixels() / tileNumberOfPixels;
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+typename TBBImageToImageFilter< TInputImage, TOutputImage >::OutputImageRegionType
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobRegion(JobIdType jobId) const
+{
+  OutputImageRegionType jobRegion;
+  this->GetJobRangeRegion(jobId, jobId + 1, jobRegion);
+  return jobRegion;
+}
 
-    // Heuristic NbReduceDimensions
-    m_NumberOfDimensionToReduce = 0;
-    m_NumberOfJobs = 1;
-    int current_dim = OutputImageDimension-1;
+template< typename TInputImage, typename TOutputImage >
+typename TBBImageToImageFilter< TInputImage, TOutputImage >::JobIdType
+TBBImageToImageFilter< TInputImage, TOutputImage >::
+GetJobRangeRegion(JobIdType jobBegin, JobIdType jobEnd, OutputImageRegionType& region) const
+{
+  // Section of the first job: the jobs of two sections are never merged
+  const JobSectionType & section = *(std::upper_bound(m_JobSections.begin(), m_JobSections.end(), jobBegin,
+    [](JobIdType id, const JobSectionType & s) { return id < s.FirstJob; }) - 1);
+  jobEnd = std::min(jobEnd, section.FirstJob + section.NumberOfJobs);
+
+  // Same mapping for slices/lines and tiles: the fastest dimension varies first
+  SizeValueType jobPosition[OutputImageDimension];
+  JobIdType jobId = jobBegin - section.FirstJob;
+  for (unsigned int i = 0; i < OutputImageDimension; ++i)
+    {
+    jobPosition[i] = jobId % section.NumberOfJobsPerDimension[i];
+    jobId /= section.NumberOfJobsPerDimension[i];
+    }
 
-    // Minimum Number of Jobs, based on the Number of thread
-    unsigned int minNbJobs = JobPerThreadRatio * this->GetNumberOfThreads();
-    while( current_dim >= 0 && m_NumberOfJobs < minNbJobs )
+  // Extend the block of jobs along the fastest dimensions.
+  // A dimension is only extended when all the previous ones are complete,
+  // so the merged jobs always form a box.
+  JobIdType nbMergedJobs = 1;
+  SizeValueType jobExtent[OutputImageDimension];
+  std::fill(jobExtent, jobExtent + OutputImageDimension, 1);
+  for (unsigned int i = 0; i < OutputImageDimension; ++i)
+    {
+    jobExtent[i] = std::min< SizeValueType >((jobEnd - jobBegin) / nbMergedJobs,
+                                             section.NumberOfJobsPerDimension[i] - jobPosition[i]);
+    nbMergedJobs *= jobExtent[i];
+    if (jobExtent[i] < section.NumberOfJobsPerDimension[i])
       {
-      ++m_NumberOfDimensionToReduce;
-      m_NumberOfJobs *= outputSize[current_dim];
-      --current_dim;
+      break;
       }
     }
+
+  for (unsigned int i = 0; i < OutputImageDimension; ++i)
+    {
+    const SizeValueType offset = jobPosition[i] * m_JobSize[i];
+    region.SetIndex(i, section.Region.GetIndex(i) + static_cast< IndexValueType >(offset));
+    region.SetSize(i, std::min(jobExtent[i] * m_JobSize[i], section.Region.GetSize(i) - offset));
+    }
+  return nbMergedJobs;
+}
+
+template< typename TInputImage, typename TOutputImage >
+double TBBImageToImageFilter< TInputImage, TOutputImage >::GetPixelCost() const
+{
+  return 1.0;
+}
+
+template< typename TInputImage, typename TOutputImage >
+double TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobDecompositionCost() const
+{
+  return this->GetPixelCost() * m_JobDecompositionRegion.GetNumberOfPixels();
+}
+
+template< typename TInputImage, typename TOutputImage >
+typename TBBImageToImageFilter< TInputImage, TOutputImage >::JobIdType
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobGrainSize() const
+{
+  if (m_GrainSize > 0)
+    {
+    return m_GrainSize;
+    }
+  if (m_NumberOfJobs == 0 || !m_WeightedJobs.empty())
+    {
+    // The weighted Jobs already cost about the same, and at least MinimumTaskCost
+    return 1;
+    }
+
+  // Group the Jobs until a task costs at least MinimumTaskCost,
+  // keeping at least JobPerThreadRatio tasks per thread when possible
+  const double jobCost = this->GetPixelCost() * m_JobDecompositionRegion.GetNumberOfPixels() / m_NumberOfJobs;
+  const double costGrainSize = std::ceil(MinimumTaskCost / std::max(jobCost, 1e-3));
+  const JobIdType balanceGrainSize = std::max< JobIdType >(1,
+    m_NumberOfJobs / (JobPerThreadRatio * this->GetJobNumberOfThreads()));
+  return std::max< JobIdType >(1, std::min< JobIdType >(balanceGrainSize,
+    static_cast< JobIdType >(std::min(costGrainSize, static_cast< double >(m_NumberOfJobs)))));
+}
+
+template< typename TInputImage, typename TOutputImage >
+typename TBBImageToImageFilter< TInputImage, TOutputImage >::PartitionerType
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobPartitioner() const
+{
+  if (m_ParallelFirstTouch)
+    {
+    // Replays the job/thread mapping of the first touch pass
+    return AffinityPartitioner;
+    }
+  if (m_Partitioner != DefaultPartitioner)
+    {
+    return m_Partitioner;
+    }
+
+  // Expensive Jobs: one Job per task, best load balancing (historical behavior).
+  // Cheap Jobs: let TBB split the range in tasks of at least GrainSize Jobs.
+  return (this->GetJobGrainSize() > 1) ? AutoPartitioner : SimplePartitioner;
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::
+GenerateJobData(const OutputImageRegionType& region, bool skipped)
+{
+  if (m_FirstTouchPass)
+    {
+    this->FirstTouchOutput(region);
+    return;
+    }
+
+  JobRecordType record;
+  if (m_RecordJobStatistics)
+    {
+    record.Region = region;
+    record.Worker = this->GetJobWorker();
+    record.Start = std::chrono::duration< double >(std::chrono::steady_clock::now() - m_JobTimeOrigin).count();
+    }
+  if (skipped)
+    {
+    this->FillSkippedOutput(region);
+    }
   else
     {
-    // If manually chosen m_TBBNbReduceDimensions, compute number of jobs accordingly.
-    m_NumberOfJobs = 1;
-    for (unsigned int i = OutputImageDimension - GetNumberOfDimensionToReduce(); i < OutputImageDimension; ++i)
+    this->TBBGenerateData(region);
+    }
+  if (m_RecordJobStatistics)
+    {
+    record.End = std::chrono::duration< double >(std::chrono::steady_clock::now() - m_JobTimeOrigin).count();
+    m_WorkerJobRecords[record.Worker].push_back(record);
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::FirstTouchOutput(const OutputImageRegionType& region)
+{
+  this->FillOutputRegion(region, NumericTraits< OutputImagePixelType >::ZeroValue());
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::FillSkippedOutput(const OutputImageRegionType& region)
+{
+  this->FillOutputRegion(region, NumericTraits< OutputImagePixelType >::ZeroValue());
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::
+FillOutputRegion(const OutputImageRegionType & region, const OutputImagePixelType & value)
+{
+  ImageRegionIterator< TOutputImage > it(this->GetOutput(), region);
+  for (; !it.IsAtEnd(); ++it)
+    {
+    it.Set(value);
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+unsigned int TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobWorker() const
+{
+#ifdef ITK_USE_TBB
+  return static_cast< unsigned int >(tbb::this_task_arena::current_thread_index());
+#else
+  return GetJobThreadId();
+#endif // ITK_USE_TBB
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::BeginJobRecording(unsigned int numberOfWorkers)
+{
+  m_JobRecords.clear();
+  m_JobStatistics = JobStatisticsType();
+  if (!m_RecordJobStatistics)
+    {
+    return;
+    }
+
+  m_WorkerJobRecords.assign(std::max(1u, numberOfWorkers), JobRecordContainerType());
+  m_JobStatistics.NumberOfWorkers = static_cast< unsigned int >(m_WorkerJobRecords.size());
+  m_JobTimeOrigin = std::chrono::steady_clock::now();
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::EndJobRecording()
+{
+  if (!m_RecordJobStatistics)
+    {
+    return;
+    }
+
+  JobStatisticsType & statistics = m_JobStatistics;
+  statistics.TotalTime = std::chrono::duration< double >(std::chrono::steady_clock::now() - m_JobTimeOrigin).count();
+
+  // Merge the records of the workers, and the busy time of each worker
+  double maximumWorkerTime = 0.0;
+  for (const JobRecordContainerType & workerRecords : m_WorkerJobRecords)
+    {
+    double workerTime = 0.0;
+    for (const JobRecordType & record : workerRecords)
       {
-      m_NumberOfJobs *= outputSize[i];
+      const double jobTime = record.End - record.Start;
+      workerTime += jobTime;
+      statistics.MaximumJobTime = std::max(statistics.MaximumJobTime, jobTime);
+      }
+    statistics.TotalJobTime += workerTime;
+    maximumWorkerTime = std::max(maximumWorkerTime, workerTime);
+    m_JobRecords.insert(m_JobRecords.end(), workerRecords.begin(), workerRecords.end());
+    }
+  m_WorkerJobRecords.clear();
+  std::sort(m_JobRecords.begin(), m_JobRecords.end(),
+            [](const JobRecordType & a, const JobRecordType & b) { return a.Start < b.Start; });
+
+  statistics.NumberOfJobs = m_JobRecords.size();
+  if (statistics.NumberOfJobs > 0)
+    {
+    statistics.MeanJobTime = statistics.TotalJobTime / statistics.NumberOfJobs;
+    }
+  if (statistics.TotalJobTime > 0.0)
+    {
+    statistics.ImbalanceRatio = maximumWorkerTime * statistics.NumberOfWorkers / statistics.TotalJobTime;
+    }
+  if (statistics.TotalTime > 0.0)
+    {
+    statistics.IdleFraction = std::max(0.0,
+      1.0 - statistics.TotalJobTime / (statistics.NumberOfWorkers * statistics.TotalTime));
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+const typename TBBImageToImageFilter< TInputImage, TOutputImage >::JobRecordContainerType &
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobRecords() const
+{
+  return m_JobRecords;
+}
+
+template< typename TInputImage, typename TOutputImage >
+const typename TBBImageToImageFilter< TInputImage, TOutputImage >::JobStatisticsType &
+TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobStatistics() const
+{
+  return m_JobStatistics;
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::WriteJobTrace(const std::string & fileName) const
+{
+  std::ofstream file(fileName.c_str());
+  if (!file)
+    {
+    itkExceptionMacro(<< "Cannot write the job trace " << fileName);
+    }
+
+  // Complete events ("ph": "X"), with the times in microseconds
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (SizeValueType i = 0; i < m_JobRecords.size(); ++i)
+    {
+    const JobRecordType & record = m_JobRecords[i];
+    file << (i > 0 ? "," : "") << std::endl
+         << "{\"name\": \"" << this->GetNameOfClass() << "\", \"cat\": \"job\", \"ph\": \"X\""
+         << ", \"ts\": " << record.Start * 1e6 << ", \"dur\": " << (record.End - record.Start) * 1e6
+         << ", \"pid\": 0, \"tid\": " << record.Worker
+         << ", \"args\": {\"index\": \"" << record.Region.GetIndex()
+         << "\", \"size\": \"" << record.Region.GetSize()
+         << "\", \"pixels\": " << record.Region.GetNumberOfPixels() << "}}";
+    }
+  file << std::endl << "]}" << std::endl;
+
+  if (!file)
+    {
+    itkExceptionMacro(<< "Cannot write the job trace " << fileName);
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBImageToImageFilter< TInputImage, TOutputImage >::ExecuteJobs(JobIdType jobBegin, JobIdType jobEnd)
+{
+  OutputImageRegionType myRegion;
+  if (m_WeightedJobs.empty())
+    {
+    // Merge the consecutive jobs into contiguous regions
+    for (JobIdType jobId = jobBegin; jobId < jobEnd; )
+      {
+      jobId += this->GetJobRangeRegion(jobId, jobEnd, myRegion);
+
+      // Run the TBBGenerateData method! (equivalent of ThreadedGenerateData)
+      this->GenerateJobData(myRegion);
+      }
+    return;
+    }
+
+  for (JobIdType weightedJobId = jobBegin; weightedJobId < jobEnd; ++weightedJobId)
+    {
+    const WeightedJobType & job = m_WeightedJobs[weightedJobId];
+    if (job.NumberOfPieces > 1)
+      {
+      // Piece of an expensive Job
+      myRegion = this->GetJobRegion(job.FirstJob);
+      const unsigned int dim = job.SplitDimension;
+      const SizeValueType size = myRegion.GetSize(dim);
+      const SizeValueType pieceBegin = size * job.Piece / job.NumberOfPieces;
+      const SizeValueType pieceEnd = size * (job.Piece + 1) / job.NumberOfPieces;
+      myRegion.SetIndex(dim, myRegion.GetIndex(dim) + static_cast< IndexValueType >(pieceBegin));
+      myRegion.SetSize(dim, pieceEnd - pieceBegin);
+      this->GenerateJobData(myRegion, job.Skipped);
+      continue;
+      }
+
+    // Group of cheap Jobs, merged into contiguous regions
+    for (JobIdType jobId = job.FirstJob; jobId < job.EndJob; )
+      {
+      jobId += this->GetJobRangeRegion(jobId, job.EndJob, myRegion);
+      this->GenerateJobData(myRegion, job.Skipped);
       }
     }
 }
@@ -211,24 +863,50 @@ ITK_THREAD_RETURN_TYPE TBBImageToImageFilter< TInputImage, TOutputImage >::MyThr
   Self *instance = (Self *)(infoStruct->UserData);
   const unsigned int threadId = infoStruct->ThreadID;
 
+  // The MultiThreader runs the thread 0 in the calling thread, which may be executing a Job
+  // of another filter sharing GetJobThreadId(): its id is restored on return (or exception).
+  struct JobThreadIdGuard
+    {
+    const ThreadIdType CallerThreadId;
+    ~JobThreadIdGuard() { GetJobThreadIdReference() = CallerThreadId; }
+    } jobThreadIdGuard = { GetJobThreadIdReference() };
+  GetJobThreadIdReference() = threadId;
+
   // Work on the workpile
-  int jobId;
+  JobIdType jobBegin = 0;
+  JobIdType jobEnd = 0;
   try
   {
-  while ( (jobId=instance->GetNextJob())>=0 )
+  if (instance->m_ParallelFirstTouch)
+    {
+    // Static mapping: the same thread first touches and computes a chunk
+    // (64 bits, so the stride doesn't wrap around with large chunks)
+    const std::uint64_t chunkSize = instance->m_JobQueueChunkSize;
+    const std::uint64_t stride = chunkSize * infoStruct->NumberOfThreads;
+    for (std::uint64_t chunkBegin = threadId * chunkSize; chunkBegin < instance->m_NumberOfJobs; chunkBegin += stride)
+      {
+      jobBegin = static_cast< JobIdType >(chunkBegin);
+      jobEnd = static_cast< JobIdType >(std::min< std::uint64_t >(chunkBegin + chunkSize, instance->m_NumberOfJobs));
+      instance->ExecuteJobs(jobBegin, jobEnd);
+      }
+    }
+  else
     {
-    instance->ExecuteJob(jobId);
+    while ( instance->GetNextJobs(jobBegin, jobEnd) )
+      {
+      instance->ExecuteJobs(jobBegin, jobEnd);
+      }
     }
   }
   catch (itk::ExceptionObject& e)
   {
-    std::cout<< "THREAD ID"<<threadId<<" / JOB ID << " << jobId << ": ITK EXCEPTION ERROR CAUGHT"<<std::endl
+    std::cout<< "THREAD ID"<<threadId<<" / JOB ID << " << jobBegin << ": ITK EXCEPTION ERROR CAUGHT"<<std::endl
              << e.GetDescription() << std::endl << "Cannot continue." << std::endl;
     throw e;
   }
   catch ( ... )
   {
-  std::cout<<"THREAD ID"<<threadId<<" / JOB ID << " << jobId << " : UNKNOWN EXCEPTION ERROR." << std::endl
+  std::cout<<"THREAD ID"<<threadId<<" / JOB ID << " << jobBegin << " : UNKNOWN EXCEPTION ERROR." << std::endl
           << "Cannot continue."<< std::endl;
   throw;
   }
@@ -237,60 +915,37 @@ ITK_THREAD_RETURN_TYPE TBBImageToImageFilter< TInputImage, TOutputImage >::MyThr
 }
 
 template< typename TInputImage, typename TOutputImage >
-int TBBImageToImageFilter< TInputImage, TOutputImage >::GetNextJob()
+bool TBBImageToImageFilter< TInputImage, TOutputImage >::GetNextJobs(JobIdType& jobBegin, JobIdType& jobEnd)
 {
-  int jobId = -1;
-
-  this->m_JobQueueMutex.Lock();
-  if (m_CurrentJobQueueIndex == static_cast<int>(m_NumberOfJobs))
-    jobId = -1;
-  else
+  // A single atomic increment per chunk of jobs
+  const std::uint64_t chunkBegin = m_CurrentJobQueueIndex.fetch_add(m_JobQueueChunkSize, std::memory_order_relaxed);
+  if (chunkBegin >= m_NumberOfJobs)
     {
-    jobId = m_CurrentJobQueueIndex;
-    m_CurrentJobQueueIndex++;
+    return false;
     }
-  this->m_JobQueueMutex.Unlock();
-  return jobId;
+  jobBegin = static_cast< JobIdType >(chunkBegin);
+  jobEnd = static_cast< JobIdType >(std::min< std::uint64_t >(chunkBegin + m_JobQueueChunkSize, m_NumberOfJobs));
+  return true;
 }
 
 template< typename TInputImage, typename TOutputImage >
-void TBBImageToImageFilter< TInputImage, TOutputImage >::ExecuteJob( int jobId )
+void TBBImageToImageFilter< TInputImage, TOutputImage >::ResetJobQueue()
 {
-  // Get the size of the requested region
-  typename TOutputImage::ConstPointer output = static_cast<TOutputImage *>(this->ProcessObject::GetOutput(0));
-  typename TOutputImage::SizeType outputSize = output->GetRequestedRegion().GetSize();
-  typename TOutputImage::SizeType size = outputSize;
-
-  typename TOutputImage::IndexType index;
-  index.Fill(0);
-
-  if (this->GetNumberOfDimensionToReduce() > 0)
-    {
-    unsigned int i = OutputImageDimension -
-        static_cast<unsigned int>(this->GetNumberOfDimensionToReduce());
-
-    index[i] = jobId;
-    size[i] = 1;
-    while (i < OutputImageDimension - 1)
-      {
-      index[i+1] = index[i] / outputSize[i];
-      index[i] = index[i] % outputSize[i];
-      size[i+1] = 1;
-      i++;
-      }
-    }
-
-  // Construct an itk::ImageRegion
-  OutputImageRegionType myRegion(index, size);
+  this->m_CurrentJobQueueIndex = 0;
+  this->m_JobQueueChunkSize = std::max< JobIdType >(1, std::min(this->GetJobGrainSize(), m_NumberOfJobs));
+}
 
-  // Run the ThreadedGenerateData method!
-  this->TBBGenerateData(myRegion);
+template< typename TInputImage, typename TOutputImage >
+ThreadIdType TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobThreadId()
+{
+  return GetJobThreadIdReference();
 }
 
 template< typename TInputImage, typename TOutputImage >
-void TBBImageToImageFilter< TInputImage, TOutputImage >::ResetJobQueue()
+ThreadIdType & TBBImageToImageFilter< TInputImage, TOutputImage >::GetJobThreadIdReference()
 {
-  this->m_CurrentJobQueueIndex = 0;
+  static thread_local ThreadIdType jobThreadId = 0;
+  return jobThreadId;
 }
 #endif // ITK_USE_TBB
 
@@ -305,43 +960,47 @@ void TBBImageToImageFilter< TInputImage, TOutputImage >::PrintSelf(std::ostream
      << static_cast< typename NumericTraits< DimensionReductionType >::PrintType >( m_NumberOfDimensionToReduce ) << std::endl;
   os << indent <<"Job per thread ratio: "
      << JobPerThreadRatio << std::endl;
+  os << indent << "Use tiles: " << (m_UseTiles ? "On" : "Off") << std::endl;
+  os << indent << "Tile size: " << m_TileSize << std::endl;
+  os << indent << "Tile cache size: "
+     << static_cast< typename NumericTraits< SizeValueType >::PrintType >( m_TileCacheSize ) << std::endl;
+  os << indent << "Keep whole rows: " << (m_KeepWholeRows ? "On" : "Off") << std::endl;
+  os << indent << "Job size: " << m_JobSize << std::endl;
+  os << indent << "Number of job sections: " << m_JobSections.size() << std::endl;
+  os << indent << "Job cost function: " << (m_JobCostFunction ? "Set" : "Null") << std::endl;
+  os << indent << "Number of weighted jobs: " << m_WeightedJobs.size() << std::endl;
+  os << indent << "Grain size: "
+     << static_cast< typename NumericTraits< JobIdType >::PrintType >( m_GrainSize ) << std::endl;
+  os << indent << "Partitioner: " << static_cast< int >( m_Partitioner ) << std::endl;
+  os << indent << "Parallel first touch: " << (m_ParallelFirstTouch ? "On" : "Off") << std::endl;
+  os << indent << "Record job statistics: " << (m_RecordJobStatistics ? "On" : "Off") << std::endl;
+  if (m_RecordJobStatistics)
+    {
+    os << indent << "Job statistics:" << std::endl;
+    os << indent.GetNextIndent() << "Number of jobs: " << m_JobStatistics.NumberOfJobs << std::endl;
+    os << indent.GetNextIndent() << "Number of workers: " << m_JobStatistics.NumberOfWorkers << std::endl;
+    os << indent.GetNextIndent() << "Total time: " << m_JobStatistics.TotalTime << std::endl;
+    os << indent.GetNextIndent() << "Total job time: " << m_JobStatistics.TotalJobTime << std::endl;
+    os << indent.GetNextIndent() << "Maximum job time: " << m_JobStatistics.MaximumJobTime << std::endl;
+    os << indent.GetNextIndent() << "Mean job time: " << m_JobStatistics.MeanJobTime << std::endl;
+    os << indent.GetNextIndent() << "Imbalance ratio: " << m_JobStatistics.ImbalanceRatio << std::endl;
+    os << indent.GetNextIndent() << "Idle fraction: " << m_JobStatistics.IdleFraction << std::endl;
+    }
 #ifndef ITK_USE_TBB
-  os << indent << "m_CurrentJobQueueIndex: " << m_CurrentJobQueueIndex << std::endl;
+  os << indent << "m_CurrentJobQueueIndex: " << m_CurrentJobQueueIndex.load() << std::endl;
+  os << indent << "m_JobQueueChunkSize: " << m_JobQueueChunkSize << std::endl;
 #else
   os << indent << "Number of Threads: "
      << static_cast< typename NumericTraits< ThreadIdType >::PrintType >( m_TBBNumberOfThreads ) << std::endl;
+  os << indent << "Task arena: " << (m_TaskArena ? "Set" : "Shared") << std::endl;
 #endif
 }
 
 #ifdef ITK_USE_TBB
 template< typename TInputImage, typename TOutputImage >
-void TBBFunctor<TInputImage, TOutputImage>::operator() ( const tbb::blocked_range<int>& r ) const
+void TBBFunctor<TInputImage, TOutputImage>::operator() ( const tbb::blocked_range<JobIdType>& r ) const
 {
-  typename TOutputImage::SizeType size = m_OutputSize;
-  typename TOutputImage::IndexType index;
-  index.Fill(0);
-
-  if (m_TBBFilter->GetNumberOfDimensionToReduce() > 0)
-    {
-    unsigned int i = OutputImageDimension -
-        static_cast<unsigned int>(m_TBBFilter->GetNumberOfDimensionToReduce());
-
-    index[i] = r.begin();
-    size[i] = 1;
-    while (i < OutputImageDimension - 1)
-      {
-      index[i+1] = index[i] / m_OutputSize[i];
-      index[i] = index[i] % m_OutputSize[i];
-      size[i+1] = 1;
-      i++;
-      }
-    }
-
-  // Construct an itk::ImageRegion
-  OutputImageRegionType myRegion(index, size);
-
-  // Run the TBBGenerateData method! (equivalent of ThreadedGenerateData)
-  m_TBBFilter->TBBGenerateData(myRegion);
+  m_TBBFilter->ExecuteJobs(r.begin(), r.end());
 }
 #endif // ITK_USE_TBB
 
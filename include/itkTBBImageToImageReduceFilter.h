@@ -0,0 +1,141 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBImageToImageReduceFilter_h
+#define itkTBBImageToImageReduceFilter_h
+
+#include "itkTBBImageToImageFilter.h"
+
+#ifdef ITK_USE_TBB
+#include <tbb/enumerable_thread_specific.h>
+#endif // ITK_USE_TBB
+
+#include <memory>
+#include <vector>
+
+namespace itk
+{
+
+/**
+ * \class TBBImageToImageReduceFilter
+ *
+ * \brief TBBImageToImageFilter accumulating per-thread results without locking
+ *
+ * Statistics or histogram filters implement TBBGenerateData(region, accumulator),
+ * which accumulates the results of a job in an accumulator of the job. At the end of the
+ * job, it is joined into the accumulator of the thread executing it.
+ * The jobs are the same as for TBBImageToImageFilter (see GenerateNumberOfJobs()).
+ * After all the jobs have completed, the thread accumulators are joined with
+ * JoinAccumulators(), and the joined accumulator is passed to TBBReduceData()
+ * before the AfterThreadedGenerateData() method of the subclasses is called.
+ *
+ * The jobs may start nested parallel work (a parallel_for, or the Update() of an inner
+ * TBB filter in the same task arena): while it waits, the thread may execute another
+ * job of the filter, which uses its own accumulator.
+ *
+ * With TBB, the thread accumulators are kept in a tbb::enumerable_thread_specific;
+ * without TBB, there is one accumulator per MultiThreader thread.
+ *
+ * \warning Subclasses overriding BeforeThreadedGenerateData() or AfterThreadedGenerateData()
+ *          must call the Superclass methods first.
+ * \warning The join order depends on the scheduling, so floating point
+ *          reductions may differ in the last bits between two runs.
+ *
+ * \sa TBBImageToImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TInputImage     Type of the input image.
+ * \tparam TOutputImage    Type of the output image.
+ * \tparam TAccumulator    Type of the per-thread accumulator (default constructible and copyable).
+ */
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+class TBBImageToImageReduceFilter : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBImageToImageReduceFilter);
+
+  // Standard class type alias.
+  using Self = TBBImageToImageReduceFilter;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBImageToImageReduceFilter, TBBImageToImageFilter);
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+
+  /** Type of the per-thread accumulator */
+  using AccumulatorType = TAccumulator;
+
+  /** Gets the accumulator joined at the end of the last Update() */
+  itkGetConstReferenceMacro(Accumulator, AccumulatorType);
+
+protected:
+  TBBImageToImageReduceFilter();
+  ~TBBImageToImageReduceFilter() override;
+
+  /** Accumulates the results of the job outputRegionForThread in the accumulator of the job,
+   * initialized by InitializeAccumulator(), and joined into the accumulator of the thread at the end.
+   * (Subclasses can add 'using Superclass::TBBGenerateData;' to keep the other overload visible) */
+  virtual void TBBGenerateData(const OutputImageRegionType& outputRegionForThread,
+                               AccumulatorType& accumulator) = 0;
+
+  /** Joins the accumulator other into accumulator. */
+  virtual void JoinAccumulators(AccumulatorType& accumulator, const AccumulatorType& other) const = 0;
+
+  /** Initializes a job or thread accumulator, and the joined accumulator, to the neutral
+   * element of JoinAccumulators() (default: keeps the default constructed accumulator). */
+  virtual void InitializeAccumulator(AccumulatorType& accumulator) const;
+
+  /** Final reduction step, called with the joined accumulator
+   * before the AfterThreadedGenerateData() of the subclasses (default: does nothing). */
+  virtual void TBBReduceData(const AccumulatorType& accumulator);
+
+  /** Calls TBBGenerateData(region, accumulator) with the accumulator of the job, and joins it
+   * into the accumulator of the current thread. */
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) ITK_FINAL;
+
+  /** Resets the thread accumulators. */
+  void BeforeThreadedGenerateData() override;
+
+  /** Joins the thread accumulators and calls TBBReduceData(). */
+  void AfterThreadedGenerateData() override;
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  AccumulatorType m_Accumulator;
+
+#ifdef ITK_USE_TBB
+  using ThreadAccumulatorsType = tbb::enumerable_thread_specific< AccumulatorType >;
+  std::unique_ptr< ThreadAccumulatorsType > m_ThreadAccumulators;
+#else
+  // One accumulator per MultiThreader thread
+  std::vector< AccumulatorType > m_ThreadAccumulators;
+#endif // ITK_USE_TBB
+};
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBImageToImageReduceFilter.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBImageToImageReduceFilter_h
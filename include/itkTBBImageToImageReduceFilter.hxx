@@ -0,0 +1,128 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBImageToImageReduceFilter_hxx
+#define itkTBBImageToImageReduceFilter_hxx
+
+#include "itkTBBImageToImageReduceFilter.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::TBBImageToImageReduceFilter()
+{
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::~TBBImageToImageReduceFilter()
+{
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+void TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::
+InitializeAccumulator(AccumulatorType& accumulator) const
+{
+  (void)accumulator;
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+void TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::
+TBBReduceData(const AccumulatorType& accumulator)
+{
+  (void)accumulator;
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+void TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::BeforeThreadedGenerateData()
+{
+  Superclass::BeforeThreadedGenerateData();
+
+#ifdef ITK_USE_TBB
+  // The thread accumulators are created (and initialized) by the first job of each thread
+  m_ThreadAccumulators.reset(new ThreadAccumulatorsType());
+#else
+  m_ThreadAccumulators.assign(std::max< ThreadIdType >(1, this->GetNumberOfThreads()), AccumulatorType());
+  for (AccumulatorType & threadAccumulator : m_ThreadAccumulators)
+    {
+    this->InitializeAccumulator(threadAccumulator);
+    }
+#endif // ITK_USE_TBB
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+void TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::
+TBBGenerateData(const OutputImageRegionType& outputRegionForThread)
+{
+  // The accumulator of the thread is only taken once the job is done: the nested parallel work
+  // of the job may execute another job of the filter in this thread
+  AccumulatorType jobAccumulator = AccumulatorType();
+  this->InitializeAccumulator(jobAccumulator);
+  this->TBBGenerateData(outputRegionForThread, jobAccumulator);
+
+#ifdef ITK_USE_TBB
+  bool exists;
+  AccumulatorType & threadAccumulator = m_ThreadAccumulators->local(exists);
+  if (!exists)
+    {
+    this->InitializeAccumulator(threadAccumulator);
+    }
+#else
+  AccumulatorType & threadAccumulator = m_ThreadAccumulators[this->GetJobThreadId()];
+#endif // ITK_USE_TBB
+
+  this->JoinAccumulators(threadAccumulator, jobAccumulator);
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+void TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::AfterThreadedGenerateData()
+{
+  // Join the thread accumulators
+  m_Accumulator = AccumulatorType();
+  this->InitializeAccumulator(m_Accumulator);
+#ifdef ITK_USE_TBB
+  for (const AccumulatorType & threadAccumulator : *m_ThreadAccumulators)
+    {
+    this->JoinAccumulators(m_Accumulator, threadAccumulator);
+    }
+  m_ThreadAccumulators.reset();
+#else
+  for (const AccumulatorType & threadAccumulator : m_ThreadAccumulators)
+    {
+    this->JoinAccumulators(m_Accumulator, threadAccumulator);
+    }
+  m_ThreadAccumulators.clear();
+#endif // ITK_USE_TBB
+
+  // Final reduction step
+  this->TBBReduceData(m_Accumulator);
+
+  Superclass::AfterThreadedGenerateData();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TAccumulator >
+void TBBImageToImageReduceFilter< TInputImage, TOutputImage, TAccumulator >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+}
+
+}  //namespace itk
+
+#endif // itkTBBImageToImageReduceFilter_hxx
@@ -0,0 +1,127 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBNeighborhoodImageFilter_h
+#define itkTBBNeighborhoodImageFilter_h
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/**
+ * \class TBBNeighborhoodImageFilter
+ *
+ * \brief TBBImageToImageFilter for neighborhood operations, with interior and boundary Jobs
+ *
+ * The filter requests the output region padded by the Radius from the input, and splits
+ * the requested output region (in the spirit of NeighborhoodAlgorithm::ImageBoundaryFacesCalculator)
+ * into the boundary faces, whose neighborhoods cross the buffered input region, and the interior.
+ * Each part is decomposed into Jobs as usual (see GenerateJobSections()), and the Jobs are executed
+ * by the same parallel_for:
+ * - TBBGenerateBoundaryData() for the Jobs of the faces: the neighborhoods must be bounds checked;
+ * - TBBGenerateInteriorData() for the Jobs of the interior: the neighborhoods are inside the
+ *   buffered input region, so they can be read without any check.
+ *
+ * The boundary Jobs are numbered first, so they are started first and don't become the stragglers
+ * (strictly in order without TBB; with TBB, the thread starting the parallel_for processes them first
+ * while the other threads steal the interior Jobs).
+ *
+ * \sa TBBImageToImageFilter, NeighborhoodAlgorithm::ImageBoundaryFacesCalculator
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TInputImage     Type of the input image.
+ * \tparam TOutputImage    Type of the output image.
+ */
+template< typename TInputImage, typename TOutputImage >
+class TBBNeighborhoodImageFilter : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBNeighborhoodImageFilter);
+
+  // Standard class type alias.
+  using Self = TBBNeighborhoodImageFilter;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBNeighborhoodImageFilter, TBBImageToImageFilter);
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using InputImageRegionType = typename Superclass::InputImageRegionType;
+
+  /** Radius of the neighborhood, along each dimension */
+  using RadiusType = typename TInputImage::SizeType;
+
+  /** Type of the list of boundary faces */
+  using FaceListType = std::vector< OutputImageRegionType >;
+
+  static_assert(TInputImage::ImageDimension == TOutputImage::ImageDimension,
+                "The input and output images must have the same dimension");
+
+  /** Set/Get the radius of the neighborhood (default: 1 along each dimension). */
+  itkSetMacro(Radius, RadiusType);
+  itkGetConstReferenceMacro(Radius, RadiusType);
+  void SetRadius(SizeValueType radius);
+
+  /** Gets the interior region and the boundary faces of the last Update().
+   * Together, they cover the requested output region without overlapping. */
+  itkGetConstReferenceMacro(InteriorRegion, OutputImageRegionType);
+  itkGetConstReferenceMacro(BoundaryFaces, FaceListType);
+
+protected:
+  TBBNeighborhoodImageFilter();
+  ~TBBNeighborhoodImageFilter() override;
+
+  /** Computes the output pixels of a Job of the interior: the neighborhoods of the pixels
+   * are inside the buffered input region (fast path, without bounds checking). */
+  virtual void TBBGenerateInteriorData(const OutputImageRegionType& outputRegionForThread) = 0;
+
+  /** Computes the output pixels of a Job of a boundary face: the neighborhoods of the pixels
+   * may cross the buffered input region (bounds checked path). */
+  virtual void TBBGenerateBoundaryData(const OutputImageRegionType& outputRegionForThread) = 0;
+
+  /** Calls TBBGenerateInteriorData() or TBBGenerateBoundaryData(). */
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) ITK_FINAL;
+
+  /** Requests the output region padded by the Radius (cropped by the largest possible region). */
+  void GenerateInputRequestedRegion() override;
+
+  /** The boundary faces, then the interior. */
+  void GenerateJobSections(const OutputImageRegionType & requestedRegion,
+                           std::vector< OutputImageRegionType > & sections) override;
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  RadiusType            m_Radius;
+  OutputImageRegionType m_InteriorRegion;
+  FaceListType          m_BoundaryFaces;
+};
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBNeighborhoodImageFilter.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBNeighborhoodImageFilter_h
@@ -0,0 +1,137 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBNeighborhoodImageFilter_hxx
+#define itkTBBNeighborhoodImageFilter_hxx
+
+#include "itkTBBNeighborhoodImageFilter.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template< typename TInputImage, typename TOutputImage >
+TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::TBBNeighborhoodImageFilter()
+{
+  m_Radius.Fill(1);
+}
+
+template< typename TInputImage, typename TOutputImage >
+TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::~TBBNeighborhoodImageFilter()
+{
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::SetRadius(SizeValueType radius)
+{
+  RadiusType radiusND;
+  radiusND.Fill(radius);
+  this->SetRadius(radiusND);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+
+  TInputImage * input = const_cast< TInputImage * >(this->GetInput());
+  if (!input)
+    {
+    return;
+    }
+
+  InputImageRegionType inputRegion = this->GetOutput()->GetRequestedRegion();
+  inputRegion.PadByRadius(m_Radius);
+  if (!inputRegion.Crop(input->GetLargestPossibleRegion()))
+    {
+    itkExceptionMacro(<< "The requested region " << this->GetOutput()->GetRequestedRegion()
+                      << " is outside of the largest possible region of the input");
+    }
+  input->SetRequestedRegion(inputRegion);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::
+GenerateJobSections(const OutputImageRegionType & requestedRegion, std::vector< OutputImageRegionType > & sections)
+{
+  // Peel the faces off the requested region, one dimension at a time:
+  // along each dimension, the pixels closer than the Radius to the buffered input region
+  const InputImageRegionType & bufferedRegion = this->GetInput()->GetBufferedRegion();
+  m_InteriorRegion = requestedRegion;
+  m_BoundaryFaces.clear();
+  for (unsigned int i = 0; i < TOutputImage::ImageDimension; ++i)
+    {
+    const IndexValueType begin = m_InteriorRegion.GetIndex(i);
+    const IndexValueType end = begin + static_cast< IndexValueType >(m_InteriorRegion.GetSize(i));
+    const IndexValueType radius = static_cast< IndexValueType >(m_Radius[i]);
+    const IndexValueType interiorBegin = std::min(end, std::max(begin,
+      bufferedRegion.GetIndex(i) + radius));
+    const IndexValueType interiorEnd = std::min(end, std::max(interiorBegin,
+      bufferedRegion.GetIndex(i) + static_cast< IndexValueType >(bufferedRegion.GetSize(i)) - radius));
+
+    OutputImageRegionType face = m_InteriorRegion;
+    face.SetIndex(i, begin);
+    face.SetSize(i, static_cast< SizeValueType >(interiorBegin - begin));
+    if (face.GetNumberOfPixels() > 0)
+      {
+      m_BoundaryFaces.push_back(face);
+      }
+    face.SetIndex(i, interiorEnd);
+    face.SetSize(i, static_cast< SizeValueType >(end - interiorEnd));
+    if (face.GetNumberOfPixels() > 0)
+      {
+      m_BoundaryFaces.push_back(face);
+      }
+    m_InteriorRegion.SetIndex(i, interiorBegin);
+    m_InteriorRegion.SetSize(i, static_cast< SizeValueType >(interiorEnd - interiorBegin));
+    }
+
+  // The boundary Jobs first
+  sections = m_BoundaryFaces;
+  sections.push_back(m_InteriorRegion);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::
+TBBGenerateData(const OutputImageRegionType& outputRegionForThread)
+{
+  // A Job never spans two sections
+  if (m_InteriorRegion.IsInside(outputRegionForThread))
+    {
+    this->TBBGenerateInteriorData(outputRegionForThread);
+    }
+  else
+    {
+    this->TBBGenerateBoundaryData(outputRegionForThread);
+    }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void TBBNeighborhoodImageFilter< TInputImage, TOutputImage >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Radius: " << m_Radius << std::endl;
+  os << indent << "Interior region: " << m_InteriorRegion << std::endl;
+  os << indent << "Number of boundary faces: " << m_BoundaryFaces.size() << std::endl;
+}
+
+}  //namespace itk
+
+#endif // itkTBBNeighborhoodImageFilter_hxx
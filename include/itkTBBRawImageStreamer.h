@@ -0,0 +1,184 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBRawImageStreamer_h
+#define itkTBBRawImageStreamer_h
+
+#include <itkImageToImageFilter.h>
+
+#include <fstream>
+#include <string>
+
+namespace itk
+{
+
+/**
+ * \class TBBRawImageStreamer
+ *
+ * \brief Applies a TBB filter to a raw image file too large for the memory, slab by slab
+ *
+ * The input file is read, and the output file written, in slabs of whole slices along the
+ * slowest dimension (the Jobs of the filter split each slab as usual). The input region
+ * of each slab (the slab plus the halo of the filter) is obtained by propagating the
+ * requested region through the filter.
+ *
+ * The slabs are double buffered, so the three steps overlap:
+ * - the reader thread reads the input of the slab k+1;
+ * - the filter computes the slab k (on the TBB workers);
+ * - the writer thread writes the slab k-1.
+ * The two output buffers are grafted in turn as the output of the filter, so the slabs
+ * are written without copy. The ReleaseDataBeforeUpdateFlag of the filter is turned off
+ * during the Update(), to keep the memory of the buffers between the slabs.
+ *
+ * The buffers (two input slabs with their halo, and two output slabs) fit in MemoryBudget,
+ * unless SlabThickness is set. The memory allocated inside the filter is not counted.
+ *
+ * \example :
+ *   streamer->SetFilter(filter);
+ *   streamer->SetInputFileName("volume.raw");
+ *   streamer->SetOutputFileName("filtered.raw");
+ *   streamer->SetSize(size);
+ *   streamer->SetMemoryBudget(1024 * 1024 * 1024);
+ *   streamer->Update();
+ *
+ * \warning The files hold the pixels without header, in the native byte order, and the
+ *          pixels must be scalars. The filter must produce the whole output from its input
+ *          (same size), and request the whole slices of its input (as the neighborhood filters).
+ *
+ * \sa TBBImageToImageFilter, TBBImageFilterPipeline
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TFilter     Type of the filter, an ImageToImageFilter (e.g. a TBBImageToImageFilter).
+ */
+template< typename TFilter >
+class TBBRawImageStreamer : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBRawImageStreamer);
+
+  // Standard class type alias.
+  using Self = TBBRawImageStreamer;
+  using Superclass = Object;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBRawImageStreamer, Object);
+
+  using FilterType = TFilter;
+  using FilterPointer = typename FilterType::Pointer;
+  using InputImageType = typename FilterType::InputImageType;
+  using InputImagePointer = typename InputImageType::Pointer;
+  using InputImagePixelType = typename InputImageType::PixelType;
+  using OutputImageType = typename FilterType::OutputImageType;
+  using OutputImagePointer = typename OutputImageType::Pointer;
+  using OutputImagePixelType = typename OutputImageType::PixelType;
+
+  using RegionType = typename InputImageType::RegionType;
+  using SizeType = typename InputImageType::SizeType;
+  using SpacingType = typename InputImageType::SpacingType;
+  using PointType = typename InputImageType::PointType;
+
+  static constexpr unsigned int ImageDimension = InputImageType::ImageDimension;
+
+  static_assert(InputImageType::ImageDimension == OutputImageType::ImageDimension,
+                "The input and output images must have the same dimension");
+
+  /** Set/Get the filter applied to each slab. */
+  itkSetObjectMacro(Filter, FilterType);
+  itkGetModifiableObjectMacro(Filter, FilterType);
+
+  /** Set/Get the raw input and output files. */
+  itkSetStringMacro(InputFileName);
+  itkGetStringMacro(InputFileName);
+  itkSetStringMacro(OutputFileName);
+  itkGetStringMacro(OutputFileName);
+
+  /** Set/Get the size, spacing and origin of the image of the input file. */
+  itkSetMacro(Size, SizeType);
+  itkGetConstReferenceMacro(Size, SizeType);
+  itkSetMacro(Spacing, SpacingType);
+  itkGetConstReferenceMacro(Spacing, SpacingType);
+  itkSetMacro(Origin, PointType);
+  itkGetConstReferenceMacro(Origin, PointType);
+
+  /** Set/Get the number of bytes of the slab buffers (default: 256 MiB). */
+  itkSetMacro(MemoryBudget, SizeValueType);
+  itkGetConstMacro(MemoryBudget, SizeValueType);
+
+  /** Set/Get the number of slices of a slab.
+   * (SlabThickness == 0 : automatic, the thickest slabs fitting in MemoryBudget) */
+  itkSetMacro(SlabThickness, SizeValueType);
+  itkGetConstMacro(SlabThickness, SizeValueType);
+
+  /** Gets the number of slabs, and the largest number of bytes of the slab buffers
+   * in memory at once, during the last Update(). */
+  itkGetConstMacro(NumberOfSlabs, SizeValueType);
+  itkGetConstMacro(BufferSize, SizeValueType);
+
+  /** Filters the input file into the output file.
+   * \exception Thrown if a file cannot be read or written, or by the filter
+   *            (the filter is disconnected from the slab buffers in any case). */
+  void Update();
+
+protected:
+  TBBRawImageStreamer();
+  ~TBBRawImageStreamer() override;
+
+  /** Gets the region of the slab [sliceBegin, sliceEnd[ of the image. */
+  RegionType GetSlabRegion(SizeValueType sliceBegin, SizeValueType sliceEnd) const;
+
+  /** Gets the whole slices of the input needed by the filter to compute the output region
+   * (propagates the requested region through the filter). */
+  RegionType GetSlabInputRegion(const RegionType & outputRegion);
+
+  /** Reads the region (whole slices) of the input file into the buffer of the slab (reader thread). */
+  void ReadSlab(std::ifstream & file, InputImageType * slab, const RegionType & region) const;
+
+  /** Appends the buffer of the slab to the output file (writer thread). */
+  void WriteSlab(std::ofstream & file, const OutputImageType * slab) const;
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  FilterPointer     m_Filter;
+  std::string       m_InputFileName;
+  std::string       m_OutputFileName;
+  SizeType          m_Size;
+  SpacingType       m_Spacing;
+  PointType         m_Origin;
+  SizeValueType     m_MemoryBudget;
+  SizeValueType     m_SlabThickness;
+  SizeValueType     m_NumberOfSlabs;
+  SizeValueType     m_BufferSize;
+
+  // Input of the filter without buffer, to propagate the requested regions
+  InputImagePointer m_ProbeInput;
+};
+
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBRawImageStreamer.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBRawImageStreamer_h
@@ -0,0 +1,283 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBRawImageStreamer_hxx
+#define itkTBBRawImageStreamer_hxx
+
+#include "itkTBBRawImageStreamer.h"
+
+#include <algorithm>
+#include <future>
+
+namespace itk
+{
+
+template< typename TFilter >
+TBBRawImageStreamer< TFilter >::TBBRawImageStreamer():
+  m_MemoryBudget(256 * 1024 * 1024),
+  m_SlabThickness(0),
+  m_NumberOfSlabs(0),
+  m_BufferSize(0)
+{
+  m_Size.Fill(0);
+  m_Spacing.Fill(1.0);
+  m_Origin.Fill(0.0);
+  m_ProbeInput = InputImageType::New();
+}
+
+template< typename TFilter >
+TBBRawImageStreamer< TFilter >::~TBBRawImageStreamer()
+{
+}
+
+template< typename TFilter >
+typename TBBRawImageStreamer< TFilter >::RegionType
+TBBRawImageStreamer< TFilter >::GetSlabRegion(SizeValueType sliceBegin, SizeValueType sliceEnd) const
+{
+  RegionType region(m_Size);
+  region.SetIndex(ImageDimension - 1, static_cast< IndexValueType >(sliceBegin));
+  region.SetSize(ImageDimension - 1, sliceEnd - sliceBegin);
+  return region;
+}
+
+template< typename TFilter >
+typename TBBRawImageStreamer< TFilter >::RegionType
+TBBRawImageStreamer< TFilter >::GetSlabInputRegion(const RegionType & outputRegion)
+{
+  m_Filter->SetInput(m_ProbeInput);
+  OutputImageType * output = m_Filter->GetOutput();
+  output->SetRequestedRegion(outputRegion);
+  output->PropagateRequestedRegion();
+
+  // Whole slices, so the region is contiguous in the file
+  const RegionType & requestedRegion = m_ProbeInput->GetRequestedRegion();
+  return this->GetSlabRegion(static_cast< SizeValueType >(requestedRegion.GetIndex(ImageDimension - 1)),
+                             static_cast< SizeValueType >(requestedRegion.GetIndex(ImageDimension - 1)) +
+                             requestedRegion.GetSize(ImageDimension - 1));
+}
+
+template< typename TFilter >
+void TBBRawImageStreamer< TFilter >::ReadSlab(std::ifstream & file, InputImageType * slab,
+                                              const RegionType & region) const
+{
+  // The capacity of the buffer is kept between the slabs
+  slab->SetBufferedRegion(region);
+  slab->Allocate();
+
+  const SizeValueType slicePixels = region.GetNumberOfPixels() / region.GetSize(ImageDimension - 1);
+  file.seekg(static_cast< std::streamoff >(region.GetIndex(ImageDimension - 1) * slicePixels *
+                                           sizeof(InputImagePixelType)));
+  file.read(reinterpret_cast< char * >(slab->GetBufferPointer()),
+            static_cast< std::streamsize >(region.GetNumberOfPixels() * sizeof(InputImagePixelType)));
+  if (!file)
+    {
+    itkExceptionMacro(<< "Cannot read the slices [" << region.GetIndex(ImageDimension - 1) << ", "
+                      << region.GetIndex(ImageDimension - 1) + static_cast< IndexValueType >(region.GetSize(ImageDimension - 1))
+                      << "[ of " << m_InputFileName);
+    }
+}
+
+template< typename TFilter >
+void TBBRawImageStreamer< TFilter >::WriteSlab(std::ofstream & file, const OutputImageType * slab) const
+{
+  file.write(reinterpret_cast< const char * >(slab->GetBufferPointer()),
+             static_cast< std::streamsize >(slab->GetBufferedRegion().GetNumberOfPixels() * sizeof(OutputImagePixelType)));
+  if (!file)
+    {
+    itkExceptionMacro(<< "Cannot write " << m_OutputFileName);
+    }
+}
+
+template< typename TFilter >
+void TBBRawImageStreamer< TFilter >::Update()
+{
+  m_NumberOfSlabs = 0;
+  m_BufferSize = 0;
+
+  if (m_Filter.IsNull())
+    {
+    itkExceptionMacro(<< "No filter");
+    }
+  const RegionType largestRegion(m_Size);
+  if (largestRegion.GetNumberOfPixels() == 0)
+    {
+    itkExceptionMacro(<< "The size of the image is empty");
+    }
+
+  // The files are declared before the futures, which are waited for first when an exception is thrown
+  std::ifstream inputFile(m_InputFileName.c_str(), std::ios::in | std::ios::binary);
+  if (!inputFile)
+    {
+    itkExceptionMacro(<< "Cannot open " << m_InputFileName);
+    }
+  inputFile.seekg(0, std::ios::end);
+  const SizeValueType fileSize = static_cast< SizeValueType >(inputFile.tellg());
+  if (fileSize < largestRegion.GetNumberOfPixels() * sizeof(InputImagePixelType))
+    {
+    itkExceptionMacro(<< m_InputFileName << " is too small: " << fileSize << " bytes instead of "
+                      << largestRegion.GetNumberOfPixels() * sizeof(InputImagePixelType));
+    }
+  std::ofstream outputFile(m_OutputFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!outputFile)
+    {
+    itkExceptionMacro(<< "Cannot open " << m_OutputFileName);
+    }
+
+  // Restores the filter at the end of the Update(), even if an exception is thrown (the guard is
+  // declared before the futures, so the reading and writing threads have finished when it is destroyed)
+  struct FilterGuard
+    {
+    FilterType * const        Filter;
+    InputImageType * const    ProbeInput;
+    const bool                ReleaseDataBeforeUpdate;
+    ~FilterGuard()
+      {
+      Filter->SetInput(ProbeInput);
+      Filter->SetReleaseDataBeforeUpdateFlag(ReleaseDataBeforeUpdate);
+      }
+    } filterGuard = { m_Filter.GetPointer(), m_ProbeInput.GetPointer(), m_Filter->GetReleaseDataBeforeUpdateFlag() };
+  m_Filter->SetReleaseDataBeforeUpdateFlag(false);
+
+  // The output information is computed once from the unbuffered input, then the slab inputs
+  // keep the whole image as largest possible region
+  m_ProbeInput->SetRegions(largestRegion);
+  m_ProbeInput->SetSpacing(m_Spacing);
+  m_ProbeInput->SetOrigin(m_Origin);
+  m_Filter->SetInput(m_ProbeInput);
+  OutputImageType * output = m_Filter->GetOutput();
+  output->UpdateOutputInformation();
+  if (output->GetLargestPossibleRegion() != largestRegion)
+    {
+    itkExceptionMacro(<< "The output of the filter (" << m_Filter->GetNameOfClass()
+                      << ") doesn't have the size of its input");
+    }
+
+  InputImagePointer inputs[2];
+  for (InputImagePointer & input : inputs)
+    {
+    input = InputImageType::New();
+    input->CopyInformation(m_ProbeInput);
+    input->SetLargestPossibleRegion(largestRegion);
+    }
+  OutputImagePointer outputs[2];
+  for (OutputImagePointer & slabOutput : outputs)
+    {
+    slabOutput = OutputImageType::New();
+    slabOutput->CopyInformation(output);
+    }
+
+  // Slab thickness: two input slabs (with the halo of the filter) and two output slabs fit in the budget
+  const SizeValueType numberOfSlices = m_Size[ImageDimension - 1];
+  const SizeValueType slicePixels = largestRegion.GetNumberOfPixels() / numberOfSlices;
+  SizeValueType thickness = m_SlabThickness;
+  if (thickness == 0)
+    {
+    const SizeValueType middle = numberOfSlices / 2;
+    const SizeValueType halo = this->GetSlabInputRegion(this->GetSlabRegion(middle, middle + 1)).GetSize(ImageDimension - 1) - 1;
+    const SizeValueType inputSliceSize = slicePixels * sizeof(InputImagePixelType);
+    const SizeValueType outputSliceSize = slicePixels * sizeof(OutputImagePixelType);
+    const SizeValueType haloSize = 2 * halo * inputSliceSize;
+    thickness = m_MemoryBudget > haloSize ? (m_MemoryBudget - haloSize) / (2 * (inputSliceSize + outputSliceSize)) : 0;
+    if (thickness == 0)
+      {
+      itkWarningMacro(<< "The slices of the image don't fit in the memory budget (" << m_MemoryBudget << " bytes)");
+      thickness = 1;
+      }
+    }
+  thickness = std::min(thickness, numberOfSlices);
+  m_NumberOfSlabs = (numberOfSlices + thickness - 1) / thickness;
+
+  itkDebugMacro(<< "Streamer: " << m_NumberOfSlabs << " slabs of " << thickness << " slices" << std::endl)
+
+  SizeValueType inputBufferSize[2] = { 0, 0 };
+  SizeValueType outputBufferSize = 0;
+  RegionType slabInputRegion = this->GetSlabInputRegion(this->GetSlabRegion(0, thickness));
+  std::future< void > reading = std::async(std::launch::async, [&, slabInputRegion]()
+    {
+    this->ReadSlab(inputFile, inputs[0], slabInputRegion);
+    });
+  inputBufferSize[0] = slabInputRegion.GetNumberOfPixels() * sizeof(InputImagePixelType);
+  std::future< void > writing;
+
+  for (SizeValueType slab = 0; slab < m_NumberOfSlabs; ++slab)
+    {
+    const SizeValueType sliceBegin = slab * thickness;
+    const RegionType slabRegion = this->GetSlabRegion(sliceBegin, std::min(sliceBegin + thickness, numberOfSlices));
+    InputImageType * slabInput = inputs[slab % 2];
+    reading.get();
+
+    // Reads the next slab while this one is computed
+    if (slab + 1 < m_NumberOfSlabs)
+      {
+      const SizeValueType nextBegin = sliceBegin + thickness;
+      slabInputRegion = this->GetSlabInputRegion(this->GetSlabRegion(nextBegin, std::min(nextBegin + thickness, numberOfSlices)));
+      InputImageType * nextInput = inputs[(slab + 1) % 2];
+      reading = std::async(std::launch::async, [&, slabInputRegion, nextInput]()
+        {
+        this->ReadSlab(inputFile, nextInput, slabInputRegion);
+        });
+      inputBufferSize[(slab + 1) % 2] = std::max(inputBufferSize[(slab + 1) % 2],
+                                                 slabInputRegion.GetNumberOfPixels() * sizeof(InputImagePixelType));
+      }
+
+    // The filter computes the slab in the output buffer written two slabs before (the writes
+    // are sequential, so it is free), then the buffer takes the output of the filter
+    OutputImageType * slabOutput = outputs[slab % 2];
+    m_Filter->SetInput(slabInput);
+    m_Filter->GraftOutput(slabOutput);
+    output->SetRequestedRegion(slabRegion);
+    output->PropagateRequestedRegion();
+    output->UpdateOutputData();
+    slabOutput->Graft(output);
+
+    if (writing.valid())
+      {
+      writing.get();
+      }
+    writing = std::async(std::launch::async, [&, slabOutput]()
+      {
+      this->WriteSlab(outputFile, slabOutput);
+      });
+    outputBufferSize = std::max(outputBufferSize, slabRegion.GetNumberOfPixels() * sizeof(OutputImagePixelType));
+    }
+  writing.get();
+
+  m_BufferSize = inputBufferSize[0] + inputBufferSize[1] + 2 * outputBufferSize;
+
+  // Release the slabs (the input of the filter is restored by the guard)
+  output->ReleaseData();
+}
+
+template< typename TFilter >
+void TBBRawImageStreamer< TFilter >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Filter: " << (m_Filter.IsNull() ? "None" : m_Filter->GetNameOfClass()) << std::endl;
+  os << indent << "Input file name: " << m_InputFileName << std::endl;
+  os << indent << "Output file name: " << m_OutputFileName << std::endl;
+  os << indent << "Size: " << m_Size << std::endl;
+  os << indent << "Memory budget: " << m_MemoryBudget << std::endl;
+  os << indent << "Slab thickness: " << m_SlabThickness << std::endl;
+  os << indent << "Number of slabs: " << m_NumberOfSlabs << std::endl;
+  os << indent << "Buffer size: " << m_BufferSize << std::endl;
+}
+
+}  //namespace itk
+
+#endif // itkTBBRawImageStreamer_hxx
@@ -0,0 +1,85 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBTaskArenaPool_h
+#define itkTBBTaskArenaPool_h
+
+#include <tbb/task_arena.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace itk
+{
+
+/**
+ * \class TBBTaskArenaPool
+ *
+ * \brief Process-wide pool of long-lived TBB task arenas, one per concurrency.
+ *
+ * The TBB filters execute their jobs in the arena matching their number of threads,
+ * so the arenas are created once and shared by all the filters (including nested
+ * and concurrent ones) instead of being set up at each Update().
+ *
+ * \sa TBBImageToImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ */
+class TBBTaskArenaPool
+{
+public:
+  using TaskArenaType = tbb::task_arena;
+  using TaskArenaPointer = std::shared_ptr< TaskArenaType >;
+
+  /** Gets the shared arena with the given concurrency, creating it on first use.
+   * (concurrency <= 0 : default TBB concurrency) */
+  static TaskArenaPointer GetTaskArena(int concurrency)
+  {
+    if (concurrency <= 0)
+      {
+      concurrency = TaskArenaType::automatic;
+      }
+
+    std::lock_guard< std::mutex > lock(GetMutex());
+    TaskArenaPointer & taskArena = GetTaskArenas()[concurrency];
+    if (!taskArena)
+      {
+      taskArena = std::make_shared< TaskArenaType >(concurrency);
+      taskArena->initialize();
+      }
+    return taskArena;
+  }
+
+private:
+  static std::map< int, TaskArenaPointer > & GetTaskArenas()
+  {
+    static std::map< int, TaskArenaPointer > taskArenas;
+    return taskArenas;
+  }
+
+  static std::mutex & GetMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+};
+
+} // end namespace itk
+
+#endif // itkTBBTaskArenaPool_h
@@ -0,0 +1,129 @@
+/*=========================================================================
+*
+*  Copyright Insight Software Consortium
+*
+*  Licensed under the Apache License, Version 2.0 (the "License");
+*  you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*
+*         http://www.apache.org/licenses/LICENSE-2.0.txt
+*
+*  Unless required by applicable law or agreed to in writing, software
+*  distributed under the License is distributed on an "AS IS" BASIS,
+*  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*  See the License for the specific language governing permissions and
+*  limitations under the License.
+*
+*=========================================================================*/
+
+#ifndef itkTBBUnaryFunctorImageFilter_h
+#define itkTBBUnaryFunctorImageFilter_h
+
+#include "itkTBBImageToImageFilter.h"
+#include "itkTBBImageRowSpans.h"
+
+namespace itk
+{
+
+/**
+ * \class TBBUnaryFunctorImageFilter
+ *
+ * \brief TBBImageToImageFilter applying a functor to contiguous row spans of the input
+ *
+ * Instead of a pixel, the functor receives raw pointers to a span of input pixels
+ * and to the matching span of output pixels, and the number of pixels of the span:
+ *
+ * \code
+ * struct AddOne
+ * {
+ *   void operator()(const InputPixelType * input, OutputPixelType * output, SizeValueType length) const
+ *   {
+ *     for (SizeValueType i = 0; i < length; ++i)
+ *       {
+ *       output[i] = input[i] + 1;
+ *       }
+ *   }
+ * };
+ * \endcode
+ *
+ * so the compiler can vectorize the loop (or the functor can use explicit SIMD).
+ * The Jobs keep whole rows (see KeepWholeRows): a span is at least a row of the requested
+ * region, and the rows of a Job are merged into one span when the requested region covers
+ * whole rows of the input and output buffers (see TBBImageRowSpans).
+ *
+ * The functor is called concurrently by the threads, and must not modify shared state.
+ *
+ * \warning Only for itk::Image (the spans address the pixel buffers directly).
+ *
+ * \sa TBBBinaryFunctorImageFilter, TBBImageRowSpans, UnaryFunctorImageFilter
+ *
+ * \ingroup TBBImageToImageFilter
+ *
+ * \tparam TInputImage     Type of the input image.
+ * \tparam TOutputImage    Type of the output image.
+ * \tparam TFunction       Type of the span functor.
+ */
+template< typename TInputImage, typename TOutputImage, typename TFunction >
+class TBBUnaryFunctorImageFilter : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(TBBUnaryFunctorImageFilter);
+
+  // Standard class type alias.
+  using Self = TBBUnaryFunctorImageFilter;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBUnaryFunctorImageFilter, TBBImageToImageFilter);
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+  using InputImagePixelType = typename Superclass::InputImagePixelType;
+
+  using FunctorType = TFunction;
+
+  static_assert(TInputImage::ImageDimension == TOutputImage::ImageDimension,
+                "The input and output images must have the same dimension");
+
+  /** Get/Set the span functor. Setting the functor calls Modified(). */
+  FunctorType & GetFunctor() { return m_Functor; }
+  const FunctorType & GetFunctor() const { return m_Functor; }
+  void SetFunctor(const FunctorType & functor)
+  {
+    m_Functor = functor;
+    this->Modified();
+  }
+
+  /** Gets the alignment (in bytes) of the rows of the input and output buffers
+   * during the last Update() (see TBBImageRowSpans::GetRowAlignment()). */
+  itkGetConstMacro(RowAlignment, SizeValueType);
+
+protected:
+  TBBUnaryFunctorImageFilter();
+  ~TBBUnaryFunctorImageFilter() override;
+
+  /** Computes the RowAlignment. */
+  void BeforeThreadedGenerateData() override;
+
+  /** Calls the functor on the row spans of the Job. */
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override;
+
+  void PrintSelf(std::ostream &os, Indent indent) const override;
+
+private:
+  FunctorType   m_Functor;
+  SizeValueType m_RowAlignment;
+};
+}   //end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTBBUnaryFunctorImageFilter.hxx"
+#endif // ITK_MANUAL_INSTANTIATION
+
+#endif // itkTBBUnaryFunctorImageFilter_h
@@ -0,0 +1,78 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTBBUnaryFunctorImageFilter_hxx
+#define itkTBBUnaryFunctorImageFilter_hxx
+
+#include "itkTBBUnaryFunctorImageFilter.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template< typename TInputImage, typename TOutputImage, typename TFunction >
+TBBUnaryFunctorImageFilter< TInputImage, TOutputImage, TFunction >::TBBUnaryFunctorImageFilter():
+  m_RowAlignment(1)
+{
+  this->SetKeepWholeRows(true);
+}
+
+template< typename TInputImage, typename TOutputImage, typename TFunction >
+TBBUnaryFunctorImageFilter< TInputImage, TOutputImage, TFunction >::~TBBUnaryFunctorImageFilter()
+{
+}
+
+template< typename TInputImage, typename TOutputImage, typename TFunction >
+void TBBUnaryFunctorImageFilter< TInputImage, TOutputImage, TFunction >::BeforeThreadedGenerateData()
+{
+  Superclass::BeforeThreadedGenerateData();
+
+  m_RowAlignment = std::min(TBBImageRowSpans::GetRowAlignment(this->GetInput()),
+                            TBBImageRowSpans::GetRowAlignment(this->GetOutput()));
+}
+
+template< typename TInputImage, typename TOutputImage, typename TFunction >
+void TBBUnaryFunctorImageFilter< TInputImage, TOutputImage, TFunction >::
+TBBGenerateData(const OutputImageRegionType& outputRegionForThread)
+{
+  const TInputImage * input = this->GetInput();
+  TOutputImage * output = this->GetOutput();
+  const InputImagePixelType * inputBuffer = input->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = output->GetBufferPointer();
+
+  TBBImageRowSpans::ForEachSpan(outputRegionForThread,
+                                { input->GetBufferedRegion(), output->GetBufferedRegion() },
+                                [&](const typename TOutputImage::IndexType & index, SizeValueType length)
+    {
+    m_Functor(inputBuffer + input->ComputeOffset(index), outputBuffer + output->ComputeOffset(index), length);
+    });
+}
+
+template< typename TInputImage, typename TOutputImage, typename TFunction >
+void TBBUnaryFunctorImageFilter< TInputImage, TOutputImage, TFunction >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Row alignment: "
+     << static_cast< typename NumericTraits< SizeValueType >::PrintType >( m_RowAlignment ) << std::endl;
+}
+
+}  //namespace itk
+
+#endif // itkTBBUnaryFunctorImageFilter_hxx
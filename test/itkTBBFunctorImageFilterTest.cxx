@@ -0,0 +1,230 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBUnaryFunctorImageFilter.h"
+#include "itkTBBBinaryFunctorImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+#include <memory>
+
+namespace
+{
+
+// Lengths of the spans passed to a functor
+struct SpanLengths
+{
+  std::atomic< itk::SizeValueType > NumberOfSpans{ 0 };
+  std::atomic< itk::SizeValueType > NumberOfPixels{ 0 };
+  std::atomic< itk::SizeValueType > MinimumLength{ itk::NumericTraits< itk::SizeValueType >::max() };
+
+  void Add(itk::SizeValueType length)
+  {
+    ++NumberOfSpans;
+    NumberOfPixels += length;
+    itk::SizeValueType minimumLength = MinimumLength;
+    while (length < minimumLength && !MinimumLength.compare_exchange_weak(minimumLength, length))
+      {
+      }
+  }
+};
+
+// 2 * x + 1 on spans
+template< typename TInputPixel, typename TOutputPixel >
+struct AffineSpanFunctor
+{
+  std::shared_ptr< SpanLengths > Lengths = std::make_shared< SpanLengths >();
+
+  void operator()(const TInputPixel * input, TOutputPixel * output, itk::SizeValueType length) const
+  {
+    Lengths->Add(length);
+    for (itk::SizeValueType i = 0; i < length; ++i)
+      {
+      output[i] = static_cast< TOutputPixel >(2 * input[i] + 1);
+      }
+  }
+};
+
+// x - 3 * y on spans
+template< typename TInputPixel1, typename TInputPixel2, typename TOutputPixel >
+struct SubtractSpanFunctor
+{
+  std::shared_ptr< SpanLengths > Lengths = std::make_shared< SpanLengths >();
+
+  void operator()(const TInputPixel1 * input1, const TInputPixel2 * input2, TOutputPixel * output,
+                  itk::SizeValueType length) const
+  {
+    Lengths->Add(length);
+    for (itk::SizeValueType i = 0; i < length; ++i)
+      {
+      output[i] = static_cast< TOutputPixel >(input1[i] - 3 * input2[i]);
+      }
+  }
+};
+
+template< typename TImage >
+typename TImage::Pointer CreateImage(const typename TImage::SizeType & size, unsigned int seed)
+{
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions(size);
+  image->Allocate();
+  itk::ImageRegionIterator<TImage> it(image, image->GetLargestPossibleRegion());
+  for (unsigned int value = seed; !it.IsAtEnd(); ++it, ++value)
+    {
+    it.Set(static_cast<typename TImage::PixelType>((value * 7919) % 1009));
+    }
+  return image;
+}
+
+template< typename TInputImage, typename TOutputImage >
+bool IsAffine(const TInputImage * input, const TOutputImage * output, const typename TOutputImage::RegionType & region)
+{
+  itk::ImageRegionConstIterator<TInputImage> iit(input, region);
+  itk::ImageRegionConstIterator<TOutputImage> oit(output, region);
+  while(!iit.IsAtEnd())
+    {
+    if (oit.Get() != static_cast<typename TOutputImage::PixelType>(2 * iit.Get() + 1))
+      {
+      return false;
+      }
+    ++iit; ++oit;
+    }
+  return true;
+}
+
+bool IsPowerOfTwo(itk::SizeValueType value)
+{
+  return value > 0 && (value & (value - 1)) == 0;
+}
+
+}
+
+int itkTBBFunctorImageFilterTest( int, char* [] )
+{
+  constexpr unsigned int Dimension = 3;
+  using InputImageType = itk::Image<short, Dimension>;
+  using Input2ImageType = itk::Image<float, Dimension>;
+  using OutputImageType = itk::Image<float, Dimension>;
+  using UnaryFunctorType = AffineSpanFunctor<short, float>;
+  using UnaryFilterType = itk::TBBUnaryFunctorImageFilter<InputImageType, OutputImageType, UnaryFunctorType>;
+  using BinaryFunctorType = SubtractSpanFunctor<short, float, float>;
+  using BinaryFilterType =
+    itk::TBBBinaryFunctorImageFilter<InputImageType, Input2ImageType, OutputImageType, BinaryFunctorType>;
+
+  InputImageType::SizeType size;
+  size[0] = 37;
+  size[1] = 19;
+  size[2] = 23;
+  InputImageType::Pointer input = CreateImage<InputImageType>(size, 0);
+  Input2ImageType::Pointer input2 = CreateImage<Input2ImageType>(size, 11);
+  const itk::SizeValueType numberOfPixels = input->GetLargestPossibleRegion().GetNumberOfPixels();
+
+  // Unary: slices, lines, voxels (the rows are kept whole) and tiles
+  UnaryFilterType::Pointer unaryFilter = UnaryFilterType::New();
+  unaryFilter->SetInput(input);
+  for (int mode = -1; mode <= static_cast<int>(Dimension) + 1; ++mode)
+    {
+    UnaryFunctorType functor;
+    unaryFilter->SetFunctor(functor);
+    if (mode > static_cast<int>(Dimension))
+      {
+      UnaryFilterType::TileSizeType tileSize;
+      tileSize.Fill(4);
+      unaryFilter->UseTilesOn();
+      unaryFilter->SetTileSize(tileSize);
+      }
+    else
+      {
+      unaryFilter->SetNumberOfDimensionToReduce(mode);
+      }
+    TRY_EXPECT_NO_EXCEPTION(unaryFilter->Update());
+    TEST_EXPECT_TRUE(IsAffine(input.GetPointer(), unaryFilter->GetOutput(), input->GetLargestPossibleRegion()));
+
+    // Every span is made of whole rows
+    TEST_EXPECT_EQUAL(functor.Lengths->NumberOfPixels.load(), numberOfPixels);
+    TEST_EXPECT_TRUE(functor.Lengths->MinimumLength >= size[0]);
+    TEST_EXPECT_TRUE(IsPowerOfTwo(unaryFilter->GetRowAlignment()));
+    TEST_EXPECT_TRUE(unaryFilter->GetRowAlignment() <= itk::TBBImageRowSpans::MaximumRowAlignment);
+    }
+
+  // The rows of a slice are merged into one span
+  UnaryFunctorType sliceFunctor;
+  unaryFilter->SetFunctor(sliceFunctor);
+  unaryFilter->UseTilesOff();
+  unaryFilter->SetNumberOfDimensionToReduce(1);
+  TRY_EXPECT_NO_EXCEPTION(unaryFilter->Update());
+  TEST_EXPECT_EQUAL(sliceFunctor.Lengths->NumberOfSpans.load(), size[2]);
+  TEST_EXPECT_EQUAL(sliceFunctor.Lengths->MinimumLength.load(), size[0] * size[1]);
+
+  // Requested sub-region: spans of the requested rows only
+  InputImageType::IndexType subIndex;
+  subIndex[0] = 5;
+  subIndex[1] = 3;
+  subIndex[2] = 7;
+  InputImageType::SizeType subSize;
+  subSize[0] = 21;
+  subSize[1] = 9;
+  subSize[2] = 11;
+  const OutputImageType::RegionType subRegion(subIndex, subSize);
+  UnaryFunctorType subRegionFunctor;
+  UnaryFilterType::Pointer subRegionFilter = UnaryFilterType::New();
+  subRegionFilter->SetInput(input);
+  subRegionFilter->SetFunctor(subRegionFunctor);
+  subRegionFilter->GetOutput()->SetRequestedRegion(subRegion);
+  TRY_EXPECT_NO_EXCEPTION(subRegionFilter->Update());
+  TEST_EXPECT_TRUE(IsAffine(input.GetPointer(), subRegionFilter->GetOutput(), subRegion));
+  TEST_EXPECT_EQUAL(subRegionFunctor.Lengths->NumberOfPixels.load(), subRegion.GetNumberOfPixels());
+  TEST_EXPECT_EQUAL(subRegionFunctor.Lengths->MinimumLength.load(), subSize[0]);
+
+  // Binary
+  BinaryFunctorType binaryFunctor;
+  BinaryFilterType::Pointer binaryFilter = BinaryFilterType::New();
+  binaryFilter->SetInput1(input);
+  binaryFilter->SetInput2(input2);
+  binaryFilter->SetFunctor(binaryFunctor);
+  TEST_EXPECT_TRUE(binaryFilter->GetInput1() == input.GetPointer());
+  TEST_EXPECT_TRUE(binaryFilter->GetInput2() == input2.GetPointer());
+  TRY_EXPECT_NO_EXCEPTION(binaryFilter->Update());
+  TEST_EXPECT_EQUAL(binaryFunctor.Lengths->NumberOfPixels.load(), numberOfPixels);
+  TEST_EXPECT_TRUE(binaryFunctor.Lengths->MinimumLength >= size[0]);
+  TEST_EXPECT_TRUE(IsPowerOfTwo(binaryFilter->GetRowAlignment()));
+
+  itk::ImageRegionConstIterator<InputImageType> it1(input, input->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<Input2ImageType> it2(input2, input2->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<OutputImageType> oit(binaryFilter->GetOutput(), input->GetLargestPossibleRegion());
+  for (; !it1.IsAtEnd(); ++it1, ++it2, ++oit)
+    {
+    TEST_EXPECT_EQUAL(oit.Get(), static_cast<float>(it1.Get() - 3 * it2.Get()));
+    }
+
+  // 1D: the row is the whole image, and it may be split
+  using Image1DType = itk::Image<short, 1>;
+  using Unary1DFilterType = itk::TBBUnaryFunctorImageFilter<Image1DType, Image1DType, AffineSpanFunctor<short, short> >;
+  Image1DType::SizeType size1D;
+  size1D[0] = 1000;
+  Image1DType::Pointer input1D = CreateImage<Image1DType>(size1D, 3);
+  Unary1DFilterType::Pointer unary1DFilter = Unary1DFilterType::New();
+  unary1DFilter->SetInput(input1D);
+  TRY_EXPECT_NO_EXCEPTION(unary1DFilter->Update());
+  TEST_EXPECT_TRUE(IsAffine(input1D.GetPointer(), unary1DFilter->GetOutput(), input1D->GetLargestPossibleRegion()));
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,237 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageFilterBatch.h"
+#include "itkTBBUnaryFunctorImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkTestingMacros.h>
+
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Adds Value to each pixel, and throws on negative pixels
+class AddValueSpanFunctor
+{
+public:
+  AddValueSpanFunctor(): m_Value(1.0f) {}
+
+  void SetValue(float value) { m_Value = value; }
+
+  void operator()(const float * input, float * output, itk::SizeValueType length) const
+  {
+    for (itk::SizeValueType i = 0; i < length; ++i)
+      {
+      if (input[i] < 0.0f)
+        {
+        throw std::runtime_error("Negative pixel");
+        }
+      output[i] = input[i] + m_Value;
+      }
+  }
+
+private:
+  float m_Value;
+};
+
+using ImageType = itk::Image<float, 2>;
+using FilterType = itk::TBBUnaryFunctorImageFilter<ImageType, ImageType, AddValueSpanFunctor>;
+using BatchType = itk::TBBImageFilterBatch<FilterType>;
+
+ImageType::Pointer CreateImage(itk::SizeValueType size, float value)
+{
+  ImageType::SizeType imageSize;
+  imageSize.Fill(size);
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(imageSize);
+  image->Allocate();
+  image->FillBuffer(value);
+  return image;
+}
+
+// All the outputs exist, are distinct, and are the inputs plus value
+bool CheckOutputs(const BatchType * batch, const std::vector< ImageType::Pointer > & inputs, float value)
+{
+  std::set< const ImageType * > outputs;
+  for (unsigned int i = 0; i < inputs.size(); ++i)
+    {
+    const ImageType * output = batch->GetOutput(i);
+    if (output == nullptr || !outputs.insert(output).second ||
+        output->GetBufferedRegion() != inputs[i]->GetLargestPossibleRegion())
+      {
+      return false;
+      }
+    itk::ImageRegionConstIterator<ImageType> iit(inputs[i], inputs[i]->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator<ImageType> oit(output, output->GetBufferedRegion());
+    for (; !iit.IsAtEnd(); ++iit, ++oit)
+      {
+      if (oit.Get() != iit.Get() + value)
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+}
+
+int itkTBBImageFilterBatchTest( int, char* [] )
+{
+  // Many small images
+  std::vector< ImageType::Pointer > smallImages;
+  BatchType::Pointer batch = BatchType::New();
+  batch->SetNumberOfThreads(2);
+  for (unsigned int i = 0; i < 200; ++i)
+    {
+    smallImages.push_back(CreateImage(32, static_cast< float >(i)));
+    batch->AddInput(smallImages.back());
+    }
+  TEST_EXPECT_EQUAL(batch->GetNumberOfInputs(), 200);
+  TEST_EXPECT_EQUAL(batch->GetNumberOfThreads(), 2);
+  TEST_EXPECT_EQUAL(batch->GetParallelism(), BatchType::AutomaticParallelism);
+  TEST_EXPECT_TRUE(batch->GetOutput(0) == nullptr);
+
+  // Automatic: across the images
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  TEST_EXPECT_EQUAL(batch->GetSelectedParallelism(), BatchType::AcrossImages);
+  TEST_EXPECT_TRUE(CheckOutputs(batch, smallImages, 1.0f));
+  TEST_EXPECT_TRUE(batch->GetOutput(200) == nullptr);
+
+  // Forced parallelism: same outputs
+  batch->SetParallelism(BatchType::WithinImages);
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  TEST_EXPECT_EQUAL(batch->GetSelectedParallelism(), BatchType::WithinImages);
+  TEST_EXPECT_TRUE(CheckOutputs(batch, smallImages, 1.0f));
+  batch->SetParallelism(BatchType::AcrossImages);
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  TEST_EXPECT_EQUAL(batch->GetSelectedParallelism(), BatchType::AcrossImages);
+  TEST_EXPECT_TRUE(CheckOutputs(batch, smallImages, 1.0f));
+
+  // The outputs are kept after the next Update()
+  ImageType::Pointer keptOutput = batch->GetOutput(3);
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  TEST_EXPECT_TRUE(keptOutput.GetPointer() != batch->GetOutput(3));
+  TEST_EXPECT_EQUAL(keptOutput->GetPixel(ImageType::IndexType{{5, 7}}), 4.0f);
+
+  // Configured filters
+  batch->SetParallelism(BatchType::AutomaticParallelism);
+  batch->SetFilterFactory([]()
+    {
+    FilterType::Pointer filter = FilterType::New();
+    filter->GetFunctor().SetValue(3.0f);
+    return filter;
+    });
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  TEST_EXPECT_TRUE(CheckOutputs(batch, smallImages, 3.0f));
+
+  // The factory (not thread safe) is called in the calling thread only, once per image
+  batch->SetParallelism(BatchType::AcrossImages);
+  std::set< std::thread::id > factoryThreads;
+  unsigned int numberOfFactoryCalls = 0;
+  batch->SetFilterFactory([&]()
+    {
+    factoryThreads.insert(std::this_thread::get_id());
+    ++numberOfFactoryCalls;
+    FilterType::Pointer filter = FilterType::New();
+    filter->GetFunctor().SetValue(3.0f);
+    return filter;
+    });
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  TEST_EXPECT_TRUE(CheckOutputs(batch, smallImages, 3.0f));
+  TEST_EXPECT_EQUAL(numberOfFactoryCalls, 200);
+  TEST_EXPECT_EQUAL(factoryThreads.size(), 1);
+  TEST_EXPECT_TRUE(*factoryThreads.begin() == std::this_thread::get_id());
+  batch->SetParallelism(BatchType::AutomaticParallelism);
+
+  // Asynchronous update
+  std::future< void > done = batch->UpdateAsync();
+  done.get();
+  TEST_EXPECT_TRUE(CheckOutputs(batch, smallImages, 3.0f));
+
+  // The exception of a filter is rethrown by the future
+  ImageType::Pointer negativeImage = CreateImage(32, -1.0f);
+  batch->AddInput(negativeImage);
+  bool caught = false;
+  try
+    {
+    batch->UpdateAsync().get();
+    }
+  catch (const std::exception & e)
+    {
+    std::cout << "Caught: " << e.what() << std::endl;
+    caught = true;
+    }
+  TEST_EXPECT_TRUE(caught);
+
+  // A few large images: within the images
+  std::vector< ImageType::Pointer > largeImages;
+  BatchType::Pointer largeBatch = BatchType::New();
+  largeBatch->SetNumberOfThreads(2);
+  for (unsigned int i = 0; i < 3; ++i)
+    {
+    largeImages.push_back(CreateImage(1024, static_cast< float >(i)));
+    largeBatch->AddInput(largeImages.back());
+    }
+  TRY_EXPECT_NO_EXCEPTION(largeBatch->Update());
+  TEST_EXPECT_EQUAL(largeBatch->GetSelectedParallelism(), BatchType::WithinImages);
+  TEST_EXPECT_TRUE(CheckOutputs(largeBatch, largeImages, 1.0f));
+
+  // Single image: within the image
+  BatchType::Pointer singleBatch = BatchType::New();
+  singleBatch->AddInput(smallImages[0]);
+  TRY_EXPECT_NO_EXCEPTION(singleBatch->Update());
+  TEST_EXPECT_EQUAL(singleBatch->GetSelectedParallelism(), BatchType::WithinImages);
+  TEST_EXPECT_TRUE(CheckOutputs(singleBatch, std::vector< ImageType::Pointer >(1, smallImages[0]), 1.0f));
+
+  // Empty batch
+  singleBatch->ClearInputs();
+  TEST_EXPECT_EQUAL(singleBatch->GetNumberOfInputs(), 0);
+  TRY_EXPECT_NO_EXCEPTION(singleBatch->Update());
+  TEST_EXPECT_TRUE(singleBatch->GetOutput(0) == nullptr);
+
+  // Throughput on the small images: one Update() after the other, and the batch
+  batch->ClearInputs();
+  for (const ImageType::Pointer & image : smallImages)
+    {
+    batch->AddInput(image);
+    }
+  const auto start = std::chrono::steady_clock::now();
+  for (const ImageType::Pointer & image : smallImages)
+    {
+    FilterType::Pointer filter = FilterType::New();
+    filter->SetNumberOfThreads(2);
+    filter->SetInput(image);
+    filter->Update();
+    }
+  const auto middle = std::chrono::steady_clock::now();
+  TRY_EXPECT_NO_EXCEPTION(batch->Update());
+  const auto end = std::chrono::steady_clock::now();
+  std::cout << "Sequential updates: " << std::chrono::duration< double >(middle - start).count() << " s, "
+            << "batch: " << std::chrono::duration< double >(end - middle).count() << " s" << std::endl;
+
+  batch->Print(std::cout);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageFilterPipeline.h"
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+
+namespace itk {
+
+// 3^Dimension mean, with zero flux Neumann boundary condition.
+// Requests a halo of one pixel, and records the reads outside of the buffered input
+// and the largest output buffer.
+template< typename TInputImage, typename TOutputImage >
+class TBBHaloMeanImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBHaloMeanImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBHaloMeanImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  SizeValueType GetMaximumBufferedPixels() const { return m_MaximumBufferedPixels; }
+  bool GetReadOutsideOfBuffer() const { return m_ReadOutsideOfBuffer; }
+
+protected:
+  TBBHaloMeanImageFilterHelper(): m_MaximumBufferedPixels(0), m_ReadOutsideOfBuffer(false) {}
+
+  void GenerateInputRequestedRegion() override
+  {
+    Superclass::GenerateInputRequestedRegion();
+
+    TInputImage * input = const_cast< TInputImage * >(this->GetInput());
+    typename TInputImage::RegionType inputRegion = this->GetOutput()->GetRequestedRegion();
+    inputRegion.PadByRadius(1);
+    inputRegion.Crop(input->GetLargestPossibleRegion());
+    input->SetRequestedRegion(inputRegion);
+  }
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_MaximumBufferedPixels = std::max(m_MaximumBufferedPixels,
+                                       this->GetOutput()->GetBufferedRegion().GetNumberOfPixels());
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    const TInputImage * input = this->GetInput();
+    const typename TInputImage::RegionType & largestRegion = input->GetLargestPossibleRegion();
+    const typename TInputImage::RegionType & bufferedRegion = input->GetBufferedRegion();
+    const typename TInputImage::IndexType first = largestRegion.GetIndex();
+    const typename TInputImage::IndexType last = largestRegion.GetUpperIndex();
+    const unsigned int Dimension = TInputImage::ImageDimension;
+
+    unsigned int nbNeighbors = 1;
+    for (unsigned int i = 0; i < Dimension; ++i)
+      {
+      nbNeighbors *= 3;
+      }
+
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!oit.IsAtEnd())
+      {
+      const typename TOutputImage::IndexType center = oit.GetIndex();
+      double sum = 0.0;
+      for (unsigned int n = 0; n < nbNeighbors; ++n)
+        {
+        typename TInputImage::IndexType neighbor;
+        unsigned int code = n;
+        for (unsigned int i = 0; i < Dimension; ++i)
+          {
+          neighbor[i] = center[i] + static_cast<IndexValueType>(code % 3) - 1;
+          neighbor[i] = std::max(first[i], std::min(last[i], neighbor[i]));
+          code /= 3;
+          }
+        if (!bufferedRegion.IsInside(neighbor))
+          {
+          m_ReadOutsideOfBuffer = true;
+          continue;
+          }
+        sum += input->GetPixel(neighbor);
+        }
+      oit.Set(static_cast<OutputImagePixelType>(sum / nbNeighbors));
+      ++oit;
+      }
+  }
+
+private:
+  SizeValueType       m_MaximumBufferedPixels;
+  std::atomic< bool > m_ReadOutsideOfBuffer;
+};
+
+// Pointwise 2 * x + 1
+template< typename TInputImage, typename TOutputImage >
+class TBBAffineImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBAffineImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBAffineImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+protected:
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    ImageRegionConstIterator<TInputImage> iit(this->GetInput(), outputRegionForThread);
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      oit.Set(static_cast<OutputImagePixelType>(2 * iit.Get() + 1));
+      ++iit; ++oit;
+      }
+  }
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TImage >
+bool ImagesAreEqual(const TImage * a, const TImage * b)
+{
+  if (a->GetLargestPossibleRegion() != b->GetLargestPossibleRegion())
+    {
+    return false;
+    }
+  itk::ImageRegionConstIterator<TImage> ait(a, a->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> bit(b, b->GetLargestPossibleRegion());
+  while(!ait.IsAtEnd())
+    {
+    if (ait.Get() != bit.Get())
+      {
+      return false;
+      }
+    ++ait; ++bit;
+    }
+  return true;
+}
+
+}
+
+int itkTBBImageFilterPipelineTest( int, char* [] )
+{
+  constexpr unsigned int Dimension = 3;
+  using InputImageType = itk::Image<short, Dimension>;
+  using ImageType = itk::Image<float, Dimension>;
+  using FirstStageType = itk::TBBHaloMeanImageFilterHelper<InputImageType, ImageType>;
+  using SecondStageType = itk::TBBAffineImageFilterHelper<ImageType, ImageType>;
+  using ThirdStageType = itk::TBBHaloMeanImageFilterHelper<ImageType, ImageType>;
+  using PipelineType = itk::TBBImageFilterPipeline<InputImageType, ImageType>;
+
+  InputImageType::SizeType size;
+  size[0] = 29;
+  size[1] = 17;
+  size[2] = 41;
+  InputImageType::Pointer input = InputImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<InputImageType> iit(input, input->GetLargestPossibleRegion());
+  for (unsigned int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(static_cast<short>((value * 7919) % 1009));
+    }
+
+  // Reference: the stages chained, each one computing its whole output
+  FirstStageType::Pointer firstReference = FirstStageType::New();
+  SecondStageType::Pointer secondReference = SecondStageType::New();
+  ThirdStageType::Pointer thirdReference = ThirdStageType::New();
+  firstReference->SetInput(input);
+  secondReference->SetInput(firstReference->GetOutput());
+  thirdReference->SetInput(secondReference->GetOutput());
+  TRY_EXPECT_NO_EXCEPTION(thirdReference->Update());
+  const ImageType * reference = thirdReference->GetOutput();
+
+  // Fused pipeline, with one division, several divisions and automatic divisions
+  const unsigned int numberOfDivisions[] = { 1, 2, 7, 41, 0 };
+  for (unsigned int divisions : numberOfDivisions)
+    {
+    FirstStageType::Pointer first = FirstStageType::New();
+    SecondStageType::Pointer second = SecondStageType::New();
+    ThirdStageType::Pointer third = ThirdStageType::New();
+
+    PipelineType::Pointer pipeline = PipelineType::New();
+    pipeline->SetInput(input);
+    pipeline->AddStage(first.GetPointer());
+    pipeline->AddStage(second.GetPointer());
+    pipeline->AddStage(third.GetPointer());
+    TEST_EXPECT_EQUAL(pipeline->GetNumberOfStages(), 3u);
+    pipeline->SetNumberOfStreamDivisions(divisions);
+    if (divisions == 0)
+      {
+      // About 5 divisions
+      pipeline->SetStreamCacheSize(size[0] * size[1] * size[2] * 12 / 5);
+      }
+    TRY_EXPECT_NO_EXCEPTION(pipeline->Update());
+
+    // Bit-identical to the chained stages
+    TEST_EXPECT_TRUE(ImagesAreEqual(reference, pipeline->GetOutput()));
+    TEST_EXPECT_TRUE(!first->GetReadOutsideOfBuffer());
+    TEST_EXPECT_TRUE(!third->GetReadOutsideOfBuffer());
+
+    // The intermediate images are only allocated for a division (and its halo)
+    const itk::SizeValueType numberOfPixels = input->GetLargestPossibleRegion().GetNumberOfPixels();
+    if (divisions != 1)
+      {
+      TEST_EXPECT_TRUE(first->GetMaximumBufferedPixels() < numberOfPixels);
+      TEST_EXPECT_TRUE(third->GetMaximumBufferedPixels() < numberOfPixels);
+      }
+    TEST_EXPECT_EQUAL(first->GetOutput()->GetBufferedRegion().GetNumberOfPixels(), 0u);
+
+    // Updated again
+    pipeline->Modified();
+    TRY_EXPECT_NO_EXCEPTION(pipeline->Update());
+    TEST_EXPECT_TRUE(ImagesAreEqual(reference, pipeline->GetOutput()));
+    }
+
+  // Stages not matching the images of the pipeline
+  PipelineType::Pointer emptyPipeline = PipelineType::New();
+  emptyPipeline->SetInput(input);
+  TRY_EXPECT_EXCEPTION(emptyPipeline->Update());
+
+  SecondStageType::Pointer mismatchedStage = SecondStageType::New();
+  PipelineType::Pointer mismatchedPipeline = PipelineType::New();
+  mismatchedPipeline->SetInput(input);
+  mismatchedPipeline->AddStage(mismatchedStage.GetPointer());
+  TRY_EXPECT_EXCEPTION(mismatchedPipeline->Update());
+
+  return EXIT_SUCCESS;
+}
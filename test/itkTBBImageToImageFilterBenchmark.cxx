@@ -0,0 +1,877 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+// Benchmark of the TBBImageToImageFilter against the ImageToImageFilter (ThreadedGenerateData)
+//
+// Usage: itkTBBImageToImageFilterBenchmark output.csv [options]
+//   --quick                 small images, 1 repetition, 1 and all the threads
+//   --repetitions N         number of Update() per configuration (default: 3, the minimum time is kept)
+//   --threads 1,2,4         numbers of threads (default: powers of 2 up to the number of cores)
+//   --baseline input.csv    compares the minimum times to a previous output (regression check)
+//   --tolerance 0.25        relative slowdown tolerated by the regression check
+//   --large                 adds the linear neighborhood kernel on a 512^3 float volume (1.5 GiB),
+//                           which doesn't fit in the caches
+//   --job-queue             only the job queue microbenchmark, from 1 to 64 threads
+//
+// The pointwise kernel also runs through the TBBUnaryFunctorImageFilter (row spans instead of
+// iterators), to measure the iterator overhead.
+//
+// The TBB filters also run with UseTiles On (reduce_dimensions "tiles"): the neighborhood_linear
+// kernel, reading the buffer directly, is memory bound on the large volumes, where the tiles
+// are expected to beat the slices/lines Jobs.
+//
+// The job queue microbenchmark compares the queues of the MultiThreader backend (without TBB)
+// on cheap jobs, where the queue overhead dominates: the previous queue locking a mutex for
+// every job, against the atomic queue claiming chunks of jobs with a single fetch_add
+// (kernels "mutex", "atomic" and "atomic_chunk8"; the size is the number of jobs, and the
+// megapixels_per_second column counts millions of jobs per second).
+//
+// The TBBImageToImageFilter rows are labelled "TBB" or "MultiThreader", depending on whether
+// the module was built with ITK_USE_TBB: run the benchmark in both builds and concatenate
+// the CSV files to compare the backends.
+
+#include "itkTBBImageToImageFilter.h"
+#include "itkTBBImageToImageReduceFilter.h"
+#include "itkTBBUnaryFunctorImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkMultiThreader.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkTimeProbe.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace itk {
+
+// Pointwise kernel: 2 * x + 1
+template< typename TImage >
+struct PointwiseBenchmarkKernel
+{
+  static double Run(const TImage * input, TImage * output, const typename TImage::RegionType & region)
+  {
+    using PixelType = typename TImage::PixelType;
+    ImageRegionConstIterator<TImage> iit(input, region);
+    ImageRegionIterator<TImage> oit(output, region);
+    while(!iit.IsAtEnd())
+      {
+      oit.Set(static_cast<PixelType>(2 * iit.Get() + 1));
+      ++iit; ++oit;
+      }
+    return 0.0;
+  }
+};
+
+// Pointwise kernel on row spans: 2 * x + 1
+template< typename TPixel >
+struct PointwiseSpanBenchmarkFunctor
+{
+  void operator()(const TPixel * input, TPixel * output, SizeValueType length) const
+  {
+    for (SizeValueType i = 0; i < length; ++i)
+      {
+      output[i] = static_cast<TPixel>(2 * input[i] + 1);
+      }
+  }
+};
+
+// Neighborhood kernel: 3^Dimension mean, with zero flux Neumann boundary condition
+template< typename TImage >
+struct NeighborhoodBenchmarkKernel
+{
+  static double Run(const TImage * input, TImage * output, const typename TImage::RegionType & region)
+  {
+    using PixelType = typename TImage::PixelType;
+    const unsigned int Dimension = TImage::ImageDimension;
+    const typename TImage::RegionType & largestRegion = input->GetLargestPossibleRegion();
+    const typename TImage::IndexType first = largestRegion.GetIndex();
+    const typename TImage::IndexType last = largestRegion.GetUpperIndex();
+
+    unsigned int nbNeighbors = 1;
+    for (unsigned int i = 0; i < Dimension; ++i)
+      {
+      nbNeighbors *= 3;
+      }
+
+    ImageRegionIterator<TImage> oit(output, region);
+    while(!oit.IsAtEnd())
+      {
+      const typename TImage::IndexType center = oit.GetIndex();
+      double sum = 0.0;
+      for (unsigned int n = 0; n < nbNeighbors; ++n)
+        {
+        typename TImage::IndexType neighbor;
+        unsigned int code = n;
+        for (unsigned int i = 0; i < Dimension; ++i)
+          {
+          neighbor[i] = center[i] + static_cast<IndexValueType>(code % 3) - 1;
+          neighbor[i] = std::max(first[i], std::min(last[i], neighbor[i]));
+          code /= 3;
+          }
+        sum += input->GetPixel(neighbor);
+        }
+      oit.Set(static_cast<PixelType>(sum / nbNeighbors));
+      ++oit;
+      }
+    return 0.0;
+  }
+};
+
+// Neighborhood kernel reading the buffers directly: 3^Dimension mean, with zero flux Neumann
+// boundary condition. Each output row is the mean of the 3^(Dimension-1) neighbor rows.
+template< typename TImage >
+struct LinearNeighborhoodBenchmarkKernel
+{
+  static double Run(const TImage * input, TImage * output, const typename TImage::RegionType & region)
+  {
+    using PixelType = typename TImage::PixelType;
+    const unsigned int Dimension = TImage::ImageDimension;
+    const typename TImage::RegionType & largestRegion = input->GetLargestPossibleRegion();
+    const typename TImage::IndexType first = largestRegion.GetIndex();
+    const typename TImage::IndexType last = largestRegion.GetUpperIndex();
+    const SizeValueType rowLength = region.GetSize(0);
+
+    unsigned int nbNeighborRows = 1;
+    for (unsigned int i = 1; i < Dimension; ++i)
+      {
+      nbNeighborRows *= 3;
+      }
+    const double nbNeighbors = 3.0 * nbNeighborRows;
+
+    // One iteration per row of the region
+    typename TImage::RegionType rows = region;
+    rows.SetSize(0, 1);
+    std::vector< const PixelType * > neighborRows(nbNeighborRows);
+    ImageRegionIterator<TImage> rit(output, rows);
+    for (; !rit.IsAtEnd(); ++rit)
+      {
+      const typename TImage::IndexType rowIndex = rit.GetIndex();
+      for (unsigned int n = 0; n < nbNeighborRows; ++n)
+        {
+        typename TImage::IndexType neighbor = rowIndex;
+        neighbor[0] = first[0];
+        unsigned int code = n;
+        for (unsigned int i = 1; i < Dimension; ++i)
+          {
+          neighbor[i] = rowIndex[i] + static_cast<IndexValueType>(code % 3) - 1;
+          neighbor[i] = std::max(first[i], std::min(last[i], neighbor[i]));
+          code /= 3;
+          }
+        neighborRows[n] = input->GetBufferPointer() + input->ComputeOffset(neighbor);
+        }
+
+      PixelType * outputRow = output->GetBufferPointer() + output->ComputeOffset(rowIndex);
+      for (SizeValueType x = 0; x < rowLength; ++x)
+        {
+        const IndexValueType center = rowIndex[0] + static_cast<IndexValueType>(x) - first[0];
+        const IndexValueType previous = std::max< IndexValueType >(0, center - 1);
+        const IndexValueType next = std::min< IndexValueType >(last[0] - first[0], center + 1);
+        double sum = 0.0;
+        for (const PixelType * neighborRow : neighborRows)
+          {
+          sum += neighborRow[previous];
+          sum += neighborRow[center];
+          sum += neighborRow[next];
+          }
+        outputRow[x] = static_cast<PixelType>(sum / nbNeighbors);
+        }
+      }
+    return 0.0;
+  }
+};
+
+// Reduction kernel: sum of the pixels (the output is not written)
+template< typename TImage >
+struct ReductionBenchmarkKernel
+{
+  static double Run(const TImage * input, TImage *, const typename TImage::RegionType & region)
+  {
+    double sum = 0.0;
+    ImageRegionConstIterator<TImage> iit(input, region);
+    while(!iit.IsAtEnd())
+      {
+      sum += iit.Get();
+      ++iit;
+      }
+    return sum;
+  }
+};
+
+// TBBImageToImageFilter running a kernel
+template< typename TImage, typename TKernel >
+class TBBBenchmarkImageFilter : public TBBImageToImageFilter< TImage, TImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBBenchmarkImageFilter;
+  using Superclass = TBBImageToImageFilter< TImage, TImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBBenchmarkImageFilter, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  double GetResult() const { return 0.0; }
+
+protected:
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    TKernel::Run(this->GetInput(), this->GetOutput(), outputRegionForThread);
+  }
+};
+
+// TBBImageToImageReduceFilter running a reduction kernel
+template< typename TImage, typename TKernel >
+class TBBBenchmarkReduceImageFilter : public TBBImageToImageReduceFilter< TImage, TImage, double >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBBenchmarkReduceImageFilter;
+  using Superclass = TBBImageToImageReduceFilter< TImage, TImage, double >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using AccumulatorType = typename Superclass::AccumulatorType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBBenchmarkReduceImageFilter, TBBImageToImageReduceFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  double GetResult() const { return this->GetAccumulator(); }
+
+protected:
+  using Superclass::TBBGenerateData;
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread, AccumulatorType& sum) override
+  {
+    sum += TKernel::Run(this->GetInput(), this->GetOutput(), outputRegionForThread);
+  }
+
+  void JoinAccumulators(AccumulatorType& sum, const AccumulatorType& other) const override
+  {
+    sum += other;
+  }
+};
+
+// TBBUnaryFunctorImageFilter running the pointwise span kernel
+template< typename TImage >
+class TBBBenchmarkSpanImageFilter :
+  public TBBUnaryFunctorImageFilter< TImage, TImage, PointwiseSpanBenchmarkFunctor< typename TImage::PixelType > >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBBenchmarkSpanImageFilter;
+  using Superclass =
+    TBBUnaryFunctorImageFilter< TImage, TImage, PointwiseSpanBenchmarkFunctor< typename TImage::PixelType > >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBBenchmarkSpanImageFilter, TBBUnaryFunctorImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  double GetResult() const { return 0.0; }
+};
+
+// ImageToImageFilter (ThreadedGenerateData) running a kernel, with one partial result per thread
+template< typename TImage, typename TKernel >
+class ITKBenchmarkImageFilter : public ImageToImageFilter< TImage, TImage >
+{
+public:
+  // Standard class type alias.
+  using Self = ITKBenchmarkImageFilter;
+  using Superclass = ImageToImageFilter< TImage, TImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(ITKBenchmarkImageFilter, ImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  double GetResult() const { return m_Result; }
+
+protected:
+  ITKBenchmarkImageFilter(): m_Result(0.0) {}
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_ThreadResults.assign(this->GetNumberOfThreads(), 0.0);
+  }
+
+  void ThreadedGenerateData(const OutputImageRegionType& outputRegionForThread, ThreadIdType threadId) override
+  {
+    m_ThreadResults[threadId] += TKernel::Run(this->GetInput(), this->GetOutput(), outputRegionForThread);
+  }
+
+  void AfterThreadedGenerateData() override
+  {
+    m_Result = 0.0;
+    for (double threadResult : m_ThreadResults)
+      {
+      m_Result += threadResult;
+      }
+  }
+
+private:
+  double                m_Result;
+  std::vector< double > m_ThreadResults;
+};
+
+} // itk
+
+namespace
+{
+
+struct BenchmarkOptions
+{
+  bool                        Quick = false;
+  unsigned int                Repetitions = 3;
+  std::vector< unsigned int > Threads;
+  std::string                 BaselineFileName;
+  double                      Tolerance = 0.25;
+  bool                        Large = false;
+  bool                        JobQueue = false;
+};
+
+template< typename TPixel > struct PixelTypeName;
+template<> struct PixelTypeName< short > { static const char * Get() { return "short"; } };
+template<> struct PixelTypeName< float > { static const char * Get() { return "float"; } };
+
+// Number of columns identifying a configuration (before the timings)
+constexpr unsigned int KeyColumns = 8;
+const char * const CSVHeader = "backend,filter,kernel,dimension,pixel_type,size,threads,reduce_dimensions,"
+                               "repetitions,min_seconds,mean_seconds,megapixels_per_second";
+
+template< typename TImage >
+bool ImagesAreEqual(const TImage * a, const TImage * b)
+{
+  itk::ImageRegionConstIterator<TImage> ait(a, a->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> bit(b, b->GetLargestPossibleRegion());
+  while(!ait.IsAtEnd())
+    {
+    if (ait.Get() != bit.Get())
+      {
+      return false;
+      }
+    ++ait; ++bit;
+    }
+  return true;
+}
+
+// Updates the filter several times, and writes a CSV row with the minimum and mean times
+template< typename TFilter >
+void TimeFilter(TFilter * filter, const std::string & key, itk::SizeValueType numberOfPixels,
+                const BenchmarkOptions & options, std::ostream & csv)
+{
+  itk::TimeProbe probe;
+  for (unsigned int repetition = 0; repetition < options.Repetitions; ++repetition)
+    {
+    filter->Modified();
+    probe.Start();
+    filter->Update();
+    probe.Stop();
+    }
+
+  std::ostringstream row;
+  row << key << "," << options.Repetitions << "," << probe.GetMinimum() << "," << probe.GetMean() << ","
+      << numberOfPixels / std::max(probe.GetMinimum(), 1e-9) / 1e6;
+  csv << row.str() << std::endl;
+  std::cout << row.str() << std::endl;
+}
+
+// Benchmarks a kernel with the ImageToImageFilter and a TBB filter
+// (all the numbers of threads and dimensions to reduce, and the tiles).
+// The ImageToImageFilter is only timed when timeITKFilter is true (otherwise it is the reference).
+template< typename TImage, typename TTBBFilter, typename TITKFilter >
+bool BenchmarkKernel(const char * kernelName, const typename TImage::SizeType & size,
+                     const BenchmarkOptions & options, std::ostream & csv,
+                     const char * tbbFilterName = "TBBImageToImageFilter", bool timeITKFilter = true)
+{
+  const unsigned int Dimension = TImage::ImageDimension;
+
+  typename TImage::Pointer input = TImage::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<TImage> iit(input, input->GetLargestPossibleRegion());
+  for (unsigned int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(static_cast<typename TImage::PixelType>((value * 7919) % 1009));
+    }
+  const itk::SizeValueType numberOfPixels = input->GetLargestPossibleRegion().GetNumberOfPixels();
+
+  std::ostringstream sizeName;
+  for (unsigned int i = 0; i < Dimension; ++i)
+    {
+    sizeName << (i > 0 ? "x" : "") << size[i];
+    }
+  std::ostringstream configuration;
+  configuration << kernelName << "," << Dimension << "," << PixelTypeName< typename TImage::PixelType >::Get()
+                << "," << sizeName.str();
+
+#ifdef ITK_USE_TBB
+  const char * tbbBackend = "TBB";
+#else
+  const char * tbbBackend = "MultiThreader";
+#endif // ITK_USE_TBB
+
+  bool success = true;
+  for (unsigned int threads : options.Threads)
+    {
+    typename TITKFilter::Pointer itkFilter = TITKFilter::New();
+    itkFilter->SetInput(input);
+    itkFilter->SetNumberOfThreads(threads);
+    std::ostringstream itkKey;
+    itkKey << "MultiThreader,ImageToImageFilter," << configuration.str() << "," << threads << ",";
+    if (timeITKFilter)
+      {
+      TimeFilter(itkFilter.GetPointer(), itkKey.str(), numberOfPixels, options, csv);
+      }
+    else
+      {
+      itkFilter->Update();
+      }
+
+    // -1: automatic number of dimensions to reduce, Dimension + 1: automatic tiles
+    const int tiles = static_cast<int>(Dimension) + 1;
+    for (int reduceDimensions = -1; reduceDimensions <= tiles; ++reduceDimensions)
+      {
+      if (reduceDimensions == 0)
+        {
+        continue;
+        }
+      typename TTBBFilter::Pointer tbbFilter = TTBBFilter::New();
+      tbbFilter->SetInput(input);
+      tbbFilter->SetNumberOfThreads(threads);
+      std::ostringstream tbbKey;
+      tbbKey << tbbBackend << "," << tbbFilterName << "," << configuration.str() << "," << threads << ",";
+      if (reduceDimensions == tiles)
+        {
+        tbbFilter->UseTilesOn();
+        tbbKey << "tiles";
+        }
+      else
+        {
+        tbbFilter->SetNumberOfDimensionToReduce(reduceDimensions);
+        tbbKey << (reduceDimensions < 0 ? "auto" : std::to_string(reduceDimensions));
+        }
+      TimeFilter(tbbFilter.GetPointer(), tbbKey.str(), numberOfPixels, options, csv);
+
+      // Both filters compute the same result
+      if (!ImagesAreEqual(itkFilter->GetOutput(), tbbFilter->GetOutput()) ||
+          itkFilter->GetResult() != tbbFilter->GetResult())
+        {
+        std::cerr << "Results differ: " << tbbKey.str() << std::endl;
+        success = false;
+        }
+      }
+    }
+  return success;
+}
+
+template< unsigned int VDimension, typename TPixel >
+bool BenchmarkImage(itk::SizeValueType sizePerDimension, const BenchmarkOptions & options, std::ostream & csv)
+{
+  using ImageType = itk::Image< TPixel, VDimension >;
+  typename ImageType::SizeType size;
+  size.Fill(sizePerDimension);
+
+  using PointwiseKernel = itk::PointwiseBenchmarkKernel< ImageType >;
+  using NeighborhoodKernel = itk::NeighborhoodBenchmarkKernel< ImageType >;
+  using LinearNeighborhoodKernel = itk::LinearNeighborhoodBenchmarkKernel< ImageType >;
+  using ReductionKernel = itk::ReductionBenchmarkKernel< ImageType >;
+
+  bool success = true;
+  success &= BenchmarkKernel< ImageType,
+                              itk::TBBBenchmarkImageFilter< ImageType, PointwiseKernel >,
+                              itk::ITKBenchmarkImageFilter< ImageType, PointwiseKernel > >(
+    "pointwise", size, options, csv);
+  success &= BenchmarkKernel< ImageType,
+                              itk::TBBBenchmarkSpanImageFilter< ImageType >,
+                              itk::ITKBenchmarkImageFilter< ImageType, PointwiseKernel > >(
+    "pointwise", size, options, csv, "TBBUnaryFunctorImageFilter", false);
+  success &= BenchmarkKernel< ImageType,
+                              itk::TBBBenchmarkImageFilter< ImageType, NeighborhoodKernel >,
+                              itk::ITKBenchmarkImageFilter< ImageType, NeighborhoodKernel > >(
+    "neighborhood", size, options, csv);
+  success &= BenchmarkKernel< ImageType,
+                              itk::TBBBenchmarkImageFilter< ImageType, LinearNeighborhoodKernel >,
+                              itk::ITKBenchmarkImageFilter< ImageType, LinearNeighborhoodKernel > >(
+    "neighborhood_linear", size, options, csv);
+  success &= BenchmarkKernel< ImageType,
+                              itk::TBBBenchmarkReduceImageFilter< ImageType, ReductionKernel >,
+                              itk::ITKBenchmarkImageFilter< ImageType, ReductionKernel > >(
+    "reduction", size, options, csv);
+  return success;
+}
+
+// Large volume, much larger than the caches: the slices/lines Jobs against the tiles
+bool BenchmarkLargeVolume(const BenchmarkOptions & options, std::ostream & csv)
+{
+  using ImageType = itk::Image< float, 3 >;
+  ImageType::SizeType size;
+  size.Fill(512);
+
+  using LinearNeighborhoodKernel = itk::LinearNeighborhoodBenchmarkKernel< ImageType >;
+  return BenchmarkKernel< ImageType,
+                          itk::TBBBenchmarkImageFilter< ImageType, LinearNeighborhoodKernel >,
+                          itk::ITKBenchmarkImageFilter< ImageType, LinearNeighborhoodKernel > >(
+    "neighborhood_linear", size, options, csv);
+}
+
+// Cheap jobs executed by the MultiThreader threads through a mutex queue or an atomic queue
+struct JobQueueBenchmark
+{
+  std::uint64_t                         m_NumberOfJobs;
+  std::uint64_t                         m_ChunkSize;
+  unsigned int                          m_WorkPerJob;
+  std::vector< std::atomic< int > >     m_ExecutionCounts;
+
+  // Mutex queue (one lock per job)
+  std::uint64_t                         m_MutexQueueIndex;
+  itk::SimpleFastMutexLock              m_MutexQueueLock;
+
+  // Atomic queue (one fetch_add per chunk of jobs)
+  std::atomic< std::uint64_t >          m_AtomicQueueIndex;
+
+  JobQueueBenchmark(std::uint64_t numberOfJobs, unsigned int workPerJob):
+    m_NumberOfJobs(numberOfJobs), m_ChunkSize(1), m_WorkPerJob(workPerJob),
+    m_ExecutionCounts(numberOfJobs), m_MutexQueueIndex(0), m_AtomicQueueIndex(0)
+  {
+  }
+
+  void Reset(std::uint64_t chunkSize)
+  {
+    m_ChunkSize = chunkSize;
+    m_MutexQueueIndex = 0;
+    m_AtomicQueueIndex = 0;
+    for (std::atomic< int > & count : m_ExecutionCounts)
+      {
+      count = 0;
+      }
+  }
+
+  bool EachJobExecutedOnce() const
+  {
+    return std::all_of(m_ExecutionCounts.begin(), m_ExecutionCounts.end(),
+                       [](const std::atomic< int > & count) { return count == 1; });
+  }
+
+  void ExecuteJob(std::uint64_t jobId)
+  {
+    volatile unsigned int work = 0;
+    for (unsigned int i = 0; i < m_WorkPerJob; ++i)
+      {
+      work = work + i;
+      }
+    ++m_ExecutionCounts[jobId];
+  }
+
+  static ITK_THREAD_RETURN_TYPE MutexQueueCallback(void * arg)
+  {
+    using ThreadInfoType = itk::MultiThreader::ThreadInfoStruct;
+    JobQueueBenchmark * benchmark = static_cast< JobQueueBenchmark * >(static_cast< ThreadInfoType * >(arg)->UserData);
+    while (true)
+      {
+      benchmark->m_MutexQueueLock.Lock();
+      const std::uint64_t jobId = benchmark->m_MutexQueueIndex;
+      if (jobId < benchmark->m_NumberOfJobs)
+        {
+        ++benchmark->m_MutexQueueIndex;
+        }
+      benchmark->m_MutexQueueLock.Unlock();
+      if (jobId >= benchmark->m_NumberOfJobs)
+        {
+        break;
+        }
+      benchmark->ExecuteJob(jobId);
+      }
+    return ITK_THREAD_RETURN_VALUE;
+  }
+
+  static ITK_THREAD_RETURN_TYPE AtomicQueueCallback(void * arg)
+  {
+    using ThreadInfoType = itk::MultiThreader::ThreadInfoStruct;
+    JobQueueBenchmark * benchmark = static_cast< JobQueueBenchmark * >(static_cast< ThreadInfoType * >(arg)->UserData);
+    while (true)
+      {
+      const std::uint64_t jobBegin = benchmark->m_AtomicQueueIndex.fetch_add(benchmark->m_ChunkSize, std::memory_order_relaxed);
+      if (jobBegin >= benchmark->m_NumberOfJobs)
+        {
+        break;
+        }
+      const std::uint64_t jobEnd = std::min(jobBegin + benchmark->m_ChunkSize, benchmark->m_NumberOfJobs);
+      for (std::uint64_t jobId = jobBegin; jobId < jobEnd; ++jobId)
+        {
+        benchmark->ExecuteJob(jobId);
+        }
+      }
+    return ITK_THREAD_RETURN_VALUE;
+  }
+};
+
+// Times the mutex queue and the atomic queue (chunks of 1 and 8 jobs) from 1 to 64 threads
+bool BenchmarkJobQueue(const BenchmarkOptions & options, std::ostream & csv)
+{
+  const std::uint64_t numberOfJobs = options.Quick ? 2000 : 20000;
+  JobQueueBenchmark benchmark(numberOfJobs, 50);
+  itk::MultiThreader::Pointer multiThreader = itk::MultiThreader::New();
+
+  struct QueueType
+  {
+    const char *                 KernelName;
+    itk::ThreadFunctionType      Callback;
+    std::uint64_t                ChunkSize;
+  };
+  const QueueType queues[] = {
+    { "mutex", JobQueueBenchmark::MutexQueueCallback, 1 },
+    { "atomic", JobQueueBenchmark::AtomicQueueCallback, 1 },
+    { "atomic_chunk8", JobQueueBenchmark::AtomicQueueCallback, 8 }
+  };
+
+  bool success = true;
+  for (unsigned int threads = 1; threads <= 64; threads *= 2)
+    {
+    multiThreader->SetNumberOfThreads(threads);
+    for (const QueueType & queue : queues)
+      {
+      multiThreader->SetSingleMethod(queue.Callback, &benchmark);
+      itk::TimeProbe probe;
+      for (unsigned int repetition = 0; repetition < options.Repetitions; ++repetition)
+        {
+        benchmark.Reset(queue.ChunkSize);
+        probe.Start();
+        multiThreader->SingleMethodExecute();
+        probe.Stop();
+        if (!benchmark.EachJobExecutedOnce())
+          {
+          std::cerr << "Jobs not executed once: " << queue.KernelName << ", " << threads << " threads" << std::endl;
+          success = false;
+          }
+        }
+
+      // The MultiThreader may clamp the number of threads
+      std::ostringstream row;
+      row << "MultiThreader,JobQueue," << queue.KernelName << ",1,-," << numberOfJobs << ","
+          << multiThreader->GetNumberOfThreads() << ",-," << options.Repetitions << "," << probe.GetMinimum()
+          << "," << probe.GetMean() << "," << numberOfJobs / std::max(probe.GetMinimum(), 1e-9) / 1e6;
+      csv << row.str() << std::endl;
+      std::cout << row.str() << std::endl;
+      }
+    }
+  return success;
+}
+
+std::vector< std::string > SplitCSVLine(const std::string & line)
+{
+  std::vector< std::string > columns;
+  std::istringstream stream(line);
+  std::string column;
+  while (std::getline(stream, column, ','))
+    {
+    columns.push_back(column);
+    }
+  return columns;
+}
+
+// Minimum time of each configuration of a CSV output
+std::map< std::string, double > ReadMinimumTimes(const std::string & fileName)
+{
+  std::map< std::string, double > minimumTimes;
+  std::ifstream file(fileName.c_str());
+  std::string line;
+  while (std::getline(file, line))
+    {
+    const std::vector< std::string > columns = SplitCSVLine(line);
+    if (columns.size() < KeyColumns + 3 || line == CSVHeader)
+      {
+      continue;
+      }
+    std::string key;
+    for (unsigned int i = 0; i < KeyColumns; ++i)
+      {
+      key += columns[i] + ",";
+      }
+    minimumTimes[key] = std::atof(columns[KeyColumns + 1].c_str());
+    }
+  return minimumTimes;
+}
+
+// Compares the minimum times to the baseline, and reports the slower configurations
+bool CheckRegressions(const std::string & fileName, const BenchmarkOptions & options)
+{
+  const std::map< std::string, double > baseline = ReadMinimumTimes(options.BaselineFileName);
+  const std::map< std::string, double > current = ReadMinimumTimes(fileName);
+  if (baseline.empty())
+    {
+    std::cerr << "Cannot read the baseline " << options.BaselineFileName << std::endl;
+    return false;
+    }
+
+  unsigned int numberOfCompared = 0;
+  unsigned int numberOfRegressions = 0;
+  for (const auto & result : current)
+    {
+    const auto baselineResult = baseline.find(result.first);
+    if (baselineResult == baseline.end() || baselineResult->second <= 0.0)
+      {
+      continue;
+      }
+    ++numberOfCompared;
+    const double ratio = result.second / baselineResult->second;
+    if (ratio > 1.0 + options.Tolerance)
+      {
+      ++numberOfRegressions;
+      std::cerr << "Regression: " << result.first << " " << baselineResult->second << " s -> "
+                << result.second << " s (x" << ratio << ")" << std::endl;
+      }
+    }
+
+  std::cout << numberOfCompared << " configurations compared to the baseline, "
+            << numberOfRegressions << " regressions" << std::endl;
+  return numberOfRegressions == 0;
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  if (argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " output.csv [--quick] [--repetitions N] [--threads 1,2,4]"
+              << " [--baseline baseline.csv] [--tolerance 0.25] [--large] [--job-queue]" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string outputFileName = argv[1];
+
+  BenchmarkOptions options;
+  for (int i = 2; i < argc; ++i)
+    {
+    const std::string argument = argv[i];
+    const bool hasValue = (i + 1 < argc);
+    if (argument == "--quick")
+      {
+      options.Quick = true;
+      options.Repetitions = 1;
+      }
+    else if (argument == "--repetitions" && hasValue)
+      {
+      options.Repetitions = std::max(1, std::atoi(argv[++i]));
+      }
+    else if (argument == "--threads" && hasValue)
+      {
+      for (const std::string & threads : SplitCSVLine(argv[++i]))
+        {
+        options.Threads.push_back(std::max(1, std::atoi(threads.c_str())));
+        }
+      }
+    else if (argument == "--baseline" && hasValue)
+      {
+      options.BaselineFileName = argv[++i];
+      }
+    else if (argument == "--tolerance" && hasValue)
+      {
+      options.Tolerance = std::atof(argv[++i]);
+      }
+    else if (argument == "--large")
+      {
+      options.Large = true;
+      }
+    else if (argument == "--job-queue")
+      {
+      options.JobQueue = true;
+      }
+    else
+      {
+      std::cerr << "Unknown argument: " << argument << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  const unsigned int maximumThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if (options.Threads.empty())
+    {
+    for (unsigned int threads = 1; threads < maximumThreads && !options.Quick; threads *= 2)
+      {
+      options.Threads.push_back(threads);
+      }
+    if (options.Quick && maximumThreads > 1)
+      {
+      options.Threads.push_back(1);
+      }
+    options.Threads.push_back(maximumThreads);
+    }
+
+  std::ofstream csv(outputFileName.c_str());
+  if (!csv)
+    {
+    std::cerr << "Cannot write " << outputFileName << std::endl;
+    return EXIT_FAILURE;
+    }
+  csv << CSVHeader << std::endl;
+  std::cout << CSVHeader << std::endl;
+
+  bool success = true;
+  const itk::SizeValueType sizes2D[] = { 256, 2048 };
+  const itk::SizeValueType sizes3D[] = { 48, 192 };
+  if (options.JobQueue)
+    {
+    success &= BenchmarkJobQueue(options, csv);
+    }
+  for (unsigned int i = 0; i < (options.JobQueue ? 0u : options.Quick ? 1u : 2u); ++i)
+    {
+    success &= BenchmarkImage< 2, short >(sizes2D[i], options, csv);
+    success &= BenchmarkImage< 2, float >(sizes2D[i], options, csv);
+    success &= BenchmarkImage< 3, short >(sizes3D[i], options, csv);
+    success &= BenchmarkImage< 3, float >(sizes3D[i], options, csv);
+    }
+  if (options.Large && !options.JobQueue)
+    {
+    success &= BenchmarkLargeVolume(options, csv);
+    }
+  csv.close();
+
+  if (!options.BaselineFileName.empty())
+    {
+    success &= CheckRegressions(outputFileName, options);
+    }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,291 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace itk {
+
+// Adds 1 to each pixel, and records the regions (and workers) of the first touch pass and of the jobs.
+// Optionally sets the number of dimensions to reduce in BeforeThreadedGenerateData(),
+// and throws in the next first touch pass.
+template< typename TInputImage, typename TOutputImage >
+class TBBFirstTouchImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBFirstTouchImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using RegionWorkerType = std::pair< OutputImageRegionType, unsigned int >;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBFirstTouchImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  using Superclass::GetNumberOfJobs;
+  using Superclass::GetJobRegion;
+
+  const std::vector< RegionWorkerType > & GetTouchedRegions() const { return m_TouchedRegions; }
+  const std::vector< RegionWorkerType > & GetComputedRegions() const { return m_ComputedRegions; }
+  bool GetTouchedBeforeBeforeThreadedGenerateData() const { return m_TouchedBeforeBeforeThreadedGenerateData; }
+
+  void SetBeforeThreadedNumberOfDimensionToReduce(int numberOfDimensionToReduce)
+  {
+    m_BeforeThreadedNumberOfDimensionToReduce = numberOfDimensionToReduce;
+  }
+  void ThrowInFirstTouchOn() { m_ThrowInFirstTouch = true; }
+
+  void ClearRegions()
+  {
+    m_TouchedRegions.clear();
+    m_ComputedRegions.clear();
+  }
+
+protected:
+  TBBFirstTouchImageFilterHelper():
+    m_TouchedBeforeBeforeThreadedGenerateData(true),
+    m_BeforeThreadedNumberOfDimensionToReduce(0),
+    m_ThrowInFirstTouch(false)
+  {}
+
+  void FirstTouchOutput(const OutputImageRegionType& region) override
+  {
+    if (m_ThrowInFirstTouch)
+      {
+      m_ThrowInFirstTouch = false;
+      itkExceptionMacro(<< "First touch failure");
+      }
+    Superclass::FirstTouchOutput(region);
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_TouchedRegions.push_back(RegionWorkerType(region, this->GetJobWorker()));
+  }
+
+  void BeforeThreadedGenerateData() override
+  {
+    Superclass::BeforeThreadedGenerateData();
+    m_TouchedBeforeBeforeThreadedGenerateData &= (m_TouchedRegions.empty() == !this->GetParallelFirstTouch());
+    if (m_BeforeThreadedNumberOfDimensionToReduce > 0)
+      {
+      this->SetNumberOfDimensionToReduce(m_BeforeThreadedNumberOfDimensionToReduce);
+      }
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_ComputedRegions.push_back(RegionWorkerType(outputRegionForThread, this->GetJobWorker()));
+    }
+
+    ImageRegionConstIterator<TInputImage> iit(this->GetInput(), outputRegionForThread);
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      oit.Set(iit.Get() + 1);
+      ++iit; ++oit;
+      }
+  }
+
+private:
+  std::mutex                        m_Mutex;
+  std::vector< RegionWorkerType >   m_TouchedRegions;
+  std::vector< RegionWorkerType >   m_ComputedRegions;
+  bool                              m_TouchedBeforeBeforeThreadedGenerateData;
+  int                               m_BeforeThreadedNumberOfDimensionToReduce;
+  bool                              m_ThrowInFirstTouch;
+};
+
+} // itk
+
+namespace
+{
+
+// Index of the region containing the whole job region (-1 if none)
+template< typename TRegionWorkers, typename TRegion >
+int FindContainingRegion(const TRegionWorkers & regions, const TRegion & jobRegion)
+{
+  for (unsigned int i = 0; i < regions.size(); ++i)
+    {
+    if (regions[i].first.IsInside(jobRegion))
+      {
+      return static_cast<int>(i);
+      }
+    }
+  return -1;
+}
+
+template< typename TImage >
+bool IsIncremented(const TImage * input, const TImage * output)
+{
+  itk::ImageRegionConstIterator<TImage> iit(input, input->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> oit(output, output->GetLargestPossibleRegion());
+  while(!iit.IsAtEnd())
+    {
+    if (oit.Get() != iit.Get() + 1)
+      {
+      return false;
+      }
+    ++iit; ++oit;
+    }
+  return true;
+}
+
+}
+
+int itkTBBImageToImageFilterFirstTouchTest( int, char* [] )
+{
+  using ImageType = itk::Image<short, 3>;
+  using FilterType = itk::TBBFirstTouchImageFilterHelper<ImageType, ImageType>;
+
+  ImageType::SizeType size;
+  size[0] = 33;
+  size[1] = 21;
+  size[2] = 17;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  input->FillBuffer(7);
+
+  // Off by default: no first touch pass
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(input);
+  TEST_EXPECT_TRUE(!filter->GetParallelFirstTouch());
+  TRY_EXPECT_NO_EXCEPTION(filter->Update());
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), filter->GetOutput()));
+  TEST_EXPECT_TRUE(filter->GetTouchedRegions().empty());
+
+  // Off: the decomposition set by BeforeThreadedGenerateData() is used by the same Update()
+  FilterType::Pointer sliceFilter = FilterType::New();
+  sliceFilter->SetInput(input);
+  sliceFilter->SetNumberOfDimensionToReduce(1);
+  TRY_EXPECT_NO_EXCEPTION(sliceFilter->Update());
+  FilterType::Pointer configuredFilter = FilterType::New();
+  configuredFilter->SetInput(input);
+  configuredFilter->SetNumberOfDimensionToReduce(2);
+  configuredFilter->SetBeforeThreadedNumberOfDimensionToReduce(1);
+  TRY_EXPECT_NO_EXCEPTION(configuredFilter->Update());
+  TEST_EXPECT_EQUAL(configuredFilter->GetNumberOfJobs(), sliceFilter->GetNumberOfJobs());
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), configuredFilter->GetOutput()));
+
+  // An exception in the first touch pass doesn't leave the filter in the first touch pass
+  FilterType::Pointer throwingFilter = FilterType::New();
+  throwingFilter->SetInput(input);
+  throwingFilter->SetNumberOfThreads(1);
+  throwingFilter->ParallelFirstTouchOn();
+  throwingFilter->ThrowInFirstTouchOn();
+  TRY_EXPECT_EXCEPTION(throwingFilter->Update());
+  throwingFilter->ParallelFirstTouchOff();
+  throwingFilter->ClearRegions();
+  throwingFilter->Modified();
+  TRY_EXPECT_NO_EXCEPTION(throwingFilter->Update());
+  TEST_EXPECT_TRUE(throwingFilter->GetTouchedRegions().empty());
+  TEST_EXPECT_TRUE(!throwingFilter->GetComputedRegions().empty());
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), throwingFilter->GetOutput()));
+
+  // On, with slices, lines and tiles, and repeated updates
+  filter->ParallelFirstTouchOn();
+  for (int mode = 0; mode < 3; ++mode)
+    {
+    if (mode == 2)
+      {
+      filter->UseTilesOn();
+      filter->SetTileCacheSize(2048);
+      }
+    else
+      {
+      filter->SetNumberOfDimensionToReduce(mode + 1);
+      }
+    for (int update = 0; update < 2; ++update)
+      {
+      filter->ClearRegions();
+      filter->Modified();
+      TRY_EXPECT_NO_EXCEPTION(filter->Update());
+      TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), filter->GetOutput()));
+      TEST_EXPECT_TRUE(filter->GetTouchedBeforeBeforeThreadedGenerateData());
+
+      // The touched regions cover the output once
+      const std::vector< FilterType::RegionWorkerType > & touched = filter->GetTouchedRegions();
+      const std::vector< FilterType::RegionWorkerType > & computed = filter->GetComputedRegions();
+      itk::SizeValueType touchedPixels = 0;
+      for (const FilterType::RegionWorkerType & region : touched)
+        {
+        touchedPixels += region.first.GetNumberOfPixels();
+        }
+      TEST_EXPECT_EQUAL(touchedPixels, filter->GetOutput()->GetRequestedRegion().GetNumberOfPixels());
+
+      // The touch pattern follows the job decomposition: each job is touched within one region,
+      // and computed within one region
+      itk::SizeValueType sameWorkerJobs = 0;
+      for (FilterType::JobIdType jobId = 0; jobId < filter->GetNumberOfJobs(); ++jobId)
+        {
+        const ImageType::RegionType jobRegion = filter->GetJobRegion(jobId);
+        const int touchedRegion = FindContainingRegion(touched, jobRegion);
+        const int computedRegion = FindContainingRegion(computed, jobRegion);
+        TEST_EXPECT_TRUE(touchedRegion >= 0);
+        TEST_EXPECT_TRUE(computedRegion >= 0);
+        if (touched[touchedRegion].second == computed[computedRegion].second)
+          {
+          ++sameWorkerJobs;
+          }
+        }
+      std::cout << "Jobs computed by the worker which touched them: "
+                << sameWorkerJobs << " / " << filter->GetNumberOfJobs() << std::endl;
+
+#ifndef ITK_USE_TBB
+      // Static mapping without TBB: always the same thread
+      TEST_EXPECT_EQUAL(sameWorkerJobs, filter->GetNumberOfJobs());
+#endif // ITK_USE_TBB
+      }
+    }
+
+  // Sub-region: only the requested region is touched
+  FilterType::Pointer subRegionFilter = FilterType::New();
+  subRegionFilter->SetInput(input);
+  subRegionFilter->ParallelFirstTouchOn();
+  ImageType::IndexType subIndex;
+  subIndex[0] = 3;
+  subIndex[1] = 2;
+  subIndex[2] = 5;
+  ImageType::SizeType subSize;
+  subSize[0] = 20;
+  subSize[1] = 11;
+  subSize[2] = 9;
+  const ImageType::RegionType subRegion(subIndex, subSize);
+  subRegionFilter->GetOutput()->SetRequestedRegion(subRegion);
+  TRY_EXPECT_NO_EXCEPTION(subRegionFilter->Update());
+  for (const FilterType::RegionWorkerType & region : subRegionFilter->GetTouchedRegions())
+    {
+    TEST_EXPECT_TRUE(subRegion.IsInside(region.first));
+    }
+
+  return EXIT_SUCCESS;
+}
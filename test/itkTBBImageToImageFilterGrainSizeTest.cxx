@@ -0,0 +1,235 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+
+namespace itk {
+
+// Adds 1 to each pixel, and counts the calls to TBBGenerateData() and the processed pixels
+template< typename TInputImage, typename TOutputImage >
+class TBBCountingImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBCountingImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+  using JobIdType = typename Superclass::JobIdType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBCountingImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  itkSetMacro(PixelCostHint, double);
+
+  unsigned int GetNumberOfCalls() const { return m_NumberOfCalls; }
+  SizeValueType GetNumberOfProcessedPixels() const { return m_NumberOfProcessedPixels; }
+  JobIdType GetNumberOfGeneratedJobs() const { return this->GetNumberOfJobs(); }
+  JobIdType GetGeneratedGrainSize() const { return this->GetJobGrainSize(); }
+
+protected:
+  TBBCountingImageFilterHelper(): m_PixelCostHint(1.0), m_NumberOfCalls(0), m_NumberOfProcessedPixels(0) {}
+
+  double GetPixelCost() const override
+  {
+    return m_PixelCostHint;
+  }
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_NumberOfCalls = 0;
+    m_NumberOfProcessedPixels = 0;
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    ++m_NumberOfCalls;
+    m_NumberOfProcessedPixels += outputRegionForThread.GetNumberOfPixels();
+
+    ImageRegionConstIterator<TInputImage> iit(this->GetInput(), outputRegionForThread);
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      oit.Set(iit.Get() + 1);
+      ++iit; ++oit;
+      }
+  }
+
+private:
+  double                       m_PixelCostHint;
+  std::atomic< unsigned int >  m_NumberOfCalls;
+  std::atomic< SizeValueType > m_NumberOfProcessedPixels;
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TFilter, typename TImage >
+int CheckFilter(TFilter * filter, const TImage * input)
+{
+  TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+  // Each pixel of the requested region is processed exactly once
+  const typename TImage::RegionType & region = filter->GetOutput()->GetRequestedRegion();
+  TEST_EXPECT_EQUAL(filter->GetNumberOfProcessedPixels(), region.GetNumberOfPixels());
+
+  itk::ImageRegionConstIterator<TImage> iit(input, region);
+  itk::ImageRegionConstIterator<TImage> oit(filter->GetOutput(), region);
+  while(!iit.IsAtEnd())
+    {
+    TEST_EXPECT_EQUAL(oit.Get(), iit.Get() + 1);
+    ++iit; ++oit;
+    }
+  return EXIT_SUCCESS;
+}
+
+}
+
+int itkTBBImageToImageFilterGrainSizeTest( int, char* [] )
+{
+  constexpr unsigned int Dimension = 3;
+  using ImageType = itk::Image<int, Dimension>;
+  using FilterType = itk::TBBCountingImageFilterHelper<ImageType, ImageType>;
+
+  ImageType::SizeType size;
+  size[0] = 17;
+  size[1] = 13;
+  size[2] = 11;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<ImageType> iit(input, input->GetLargestPossibleRegion());
+  for (int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(value);
+    }
+
+  const FilterType::PartitionerType partitioners[] = {
+    FilterType::DefaultPartitioner,
+    FilterType::SimplePartitioner,
+    FilterType::AutoPartitioner,
+    FilterType::AffinityPartitioner,
+    FilterType::StaticPartitioner };
+  const FilterType::JobIdType grainSizes[] = { 0, 1, 2, 7, 13, 1000 };
+
+  // Lines, slices and tiles, with all the partitioners and grain sizes
+  for (int mode = 0; mode < 3; ++mode)
+    {
+    for (const FilterType::PartitionerType partitioner : partitioners)
+      {
+      for (const FilterType::JobIdType grainSize : grainSizes)
+        {
+        FilterType::Pointer filter = FilterType::New();
+        filter->SetInput(input);
+        filter->SetPartitioner(partitioner);
+        filter->SetGrainSize(grainSize);
+        if (mode == 2)
+          {
+          FilterType::TileSizeType tileSize;
+          tileSize[0] = 5;
+          tileSize[1] = 4;
+          tileSize[2] = 3;
+          filter->UseTilesOn();
+          filter->SetTileSize(tileSize);
+          }
+        else
+          {
+          filter->SetNumberOfDimensionToReduce(mode + 1);
+          }
+        if (CheckFilter(filter.GetPointer(), input.GetPointer()) != EXIT_SUCCESS)
+          {
+          std::cerr << "Failed with mode " << mode << ", partitioner " << partitioner
+                    << " and grain size " << grainSize << std::endl;
+          return EXIT_FAILURE;
+          }
+
+        // With a single thread, the grain size bounds the number of calls
+        if (grainSize > 1 && filter->GetNumberOfThreads() == 1)
+          {
+          TEST_EXPECT_TRUE(filter->GetNumberOfCalls() < filter->GetNumberOfGeneratedJobs());
+          }
+        }
+      }
+    }
+
+  // With a single thread, the grain size bounds the number of calls (all the partitioners)
+  for (const FilterType::PartitionerType partitioner : partitioners)
+    {
+    FilterType::Pointer singleThreadFilter = FilterType::New();
+    singleThreadFilter->SetInput(input);
+    singleThreadFilter->SetPartitioner(partitioner);
+    singleThreadFilter->SetGrainSize(7);
+    singleThreadFilter->SetNumberOfThreads(1);
+    TEST_EXPECT_EQUAL(CheckFilter(singleThreadFilter.GetPointer(), input.GetPointer()), EXIT_SUCCESS);
+    TEST_EXPECT_TRUE(singleThreadFilter->GetNumberOfCalls() < singleThreadFilter->GetNumberOfGeneratedJobs());
+    }
+
+  // A requested region which doesn't start at the origin
+  FilterType::Pointer subRegionFilter = FilterType::New();
+  subRegionFilter->SetInput(input);
+  subRegionFilter->SetGrainSize(4);
+  ImageType::IndexType subIndex;
+  subIndex[0] = 3;
+  subIndex[1] = 2;
+  subIndex[2] = 1;
+  ImageType::SizeType subSize;
+  subSize[0] = 9;
+  subSize[1] = 7;
+  subSize[2] = 5;
+  subRegionFilter->GetOutput()->SetRequestedRegion(ImageType::RegionType(subIndex, subSize));
+  if (CheckFilter(subRegionFilter.GetPointer(), input.GetPointer()) != EXIT_SUCCESS)
+    {
+    std::cerr << "Failed with a requested region not starting at the origin" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The pixel cost hint drives the automatic grain size
+  FilterType::Pointer cheapFilter = FilterType::New();
+  cheapFilter->SetInput(input);
+  cheapFilter->SetNumberOfDimensionToReduce(3);
+  cheapFilter->SetPixelCostHint(0.1);
+  TRY_EXPECT_NO_EXCEPTION(cheapFilter->Update());
+
+  FilterType::Pointer expensiveFilter = FilterType::New();
+  expensiveFilter->SetInput(input);
+  expensiveFilter->SetNumberOfDimensionToReduce(3);
+  expensiveFilter->SetPixelCostHint(1e6);
+  TRY_EXPECT_NO_EXCEPTION(expensiveFilter->Update());
+
+  std::cout << "Grain size for cheap pixels: " << cheapFilter->GetGeneratedGrainSize()
+            << ", for expensive pixels: " << expensiveFilter->GetGeneratedGrainSize() << std::endl;
+  TEST_EXPECT_EQUAL(expensiveFilter->GetGeneratedGrainSize(), 1u);
+  TEST_EXPECT_TRUE(cheapFilter->GetGeneratedGrainSize() >= expensiveFilter->GetGeneratedGrainSize());
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+namespace itk {
+
+// Computes an expensive function of each pixel of the jobs, and keeps it inside the PixelMask
+// (Background outside). Records the computed and skipped regions.
+template< typename TInputImage, typename TOutputImage >
+class TBBMaskedImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBMaskedImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using JobMaskImageType = typename Superclass::JobMaskImageType;
+  using RegionContainerType = std::vector< OutputImageRegionType >;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBMaskedImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  static constexpr float Background = -1.0f;
+
+  void SetPixelMask(const JobMaskImageType * mask) { m_PixelMask = mask; }
+
+  const RegionContainerType & GetComputedRegions() const { return m_ComputedRegions; }
+  const RegionContainerType & GetSkippedRegions() const { return m_SkippedRegions; }
+
+  static float Expensive(float value)
+  {
+    double v = value;
+    for (int i = 0; i < 32; ++i)
+      {
+      v = std::sqrt(v * v + 1.0);
+      }
+    return static_cast< float >(v);
+  }
+
+protected:
+  TBBMaskedImageFilterHelper() {}
+
+  double GetPixelCost() const override { return 100.0; }
+
+  void BeforeThreadedGenerateData() override
+  {
+    Superclass::BeforeThreadedGenerateData();
+    m_ComputedRegions.clear();
+    m_SkippedRegions.clear();
+  }
+
+  void FillSkippedOutput(const OutputImageRegionType& region) override
+  {
+    {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_SkippedRegions.push_back(region);
+    }
+
+    const float background = Background;
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), region);
+    for (; !oit.IsAtEnd(); ++oit)
+      {
+      oit.Set(background);
+      }
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_ComputedRegions.push_back(outputRegionForThread);
+    }
+
+    ImageRegionConstIterator<TInputImage> iit(this->GetInput(), outputRegionForThread);
+    ImageRegionConstIterator<JobMaskImageType> mit(m_PixelMask, outputRegionForThread);
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      const float value = Expensive(iit.Get());
+      oit.Set(mit.Get() ? value : Background);
+      ++iit; ++mit; ++oit;
+      }
+  }
+
+private:
+  typename JobMaskImageType::ConstPointer m_PixelMask;
+  std::mutex                              m_Mutex;
+  RegionContainerType                     m_ComputedRegions;
+  RegionContainerType                     m_SkippedRegions;
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TImage >
+bool AreEqual(const TImage * image1, const TImage * image2)
+{
+  itk::ImageRegionConstIterator<TImage> it1(image1, image1->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> it2(image2, image2->GetLargestPossibleRegion());
+  for (; !it1.IsAtEnd(); ++it1, ++it2)
+    {
+    if (it1.Get() != it2.Get())
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+template< typename TRegions >
+itk::SizeValueType CountPixels(const TRegions & regions)
+{
+  itk::SizeValueType numberOfPixels = 0;
+  for (const auto & region : regions)
+    {
+    numberOfPixels += region.GetNumberOfPixels();
+    }
+  return numberOfPixels;
+}
+
+// Best time of a few updates (seconds)
+template< typename TFilter >
+double TimeUpdate(TFilter * filter)
+{
+  double bestTime = 1e30;
+  for (int i = 0; i < 5; ++i)
+    {
+    filter->Modified();
+    const auto start = std::chrono::steady_clock::now();
+    filter->Update();
+    bestTime = std::min(bestTime,
+      std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count());
+    }
+  return bestTime;
+}
+
+}
+
+int itkTBBImageToImageFilterJobCostTest( int, char* [] )
+{
+  using ImageType = itk::Image<float, 3>;
+  using FilterType = itk::TBBMaskedImageFilterHelper<ImageType, ImageType>;
+  using MaskType = FilterType::JobMaskImageType;
+
+  ImageType::SizeType size;
+  size.Fill(64);
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<ImageType> iit(input, input->GetLargestPossibleRegion());
+  for (float value = 0.0f; !iit.IsAtEnd(); ++iit, value += 0.25f)
+    {
+    iit.Set(value);
+    }
+
+  // Sparse mask: a ball of radius 7 (the lines crossing it are less than 4% of the lines)
+  MaskType::Pointer mask = MaskType::New();
+  mask->SetRegions(size);
+  mask->Allocate();
+  itk::SizeValueType numberOfMaskLines = 0;
+  for (itk::IndexValueType z = 0; z < 64; ++z)
+    {
+    for (itk::IndexValueType y = 0; y < 64; ++y)
+      {
+      bool maskLine = false;
+      for (itk::IndexValueType x = 0; x < 64; ++x)
+        {
+        MaskType::IndexType index = {{x, y, z}};
+        const bool inside = (x - 32) * (x - 32) + (y - 32) * (y - 32) + (z - 32) * (z - 32) <= 49;
+        mask->SetPixel(index, inside ? 1 : 0);
+        maskLine |= inside;
+        }
+      numberOfMaskLines += maskLine ? 1 : 0;
+      }
+    }
+  TEST_EXPECT_TRUE(numberOfMaskLines * 20 < size[1] * size[2]);
+
+  // Reference: all the lines are computed
+  FilterType::Pointer reference = FilterType::New();
+  reference->SetInput(input);
+  reference->SetPixelMask(mask);
+  reference->SetNumberOfDimensionToReduce(2);
+  TEST_EXPECT_TRUE(!reference->GetJobCostFunction());
+  TEST_EXPECT_TRUE(reference->GetJobMask() == nullptr);
+  TRY_EXPECT_NO_EXCEPTION(reference->Update());
+  TEST_EXPECT_EQUAL(CountPixels(reference->GetComputedRegions()), input->GetLargestPossibleRegion().GetNumberOfPixels());
+  TEST_EXPECT_TRUE(reference->GetSkippedRegions().empty());
+  const double referenceTime = TimeUpdate(reference.GetPointer());
+
+  // JobMask: same output, only the lines crossing the mask are computed
+  FilterType::Pointer masked = FilterType::New();
+  masked->SetInput(input);
+  masked->SetPixelMask(mask);
+  masked->SetJobMask(mask);
+  masked->SetNumberOfDimensionToReduce(2);
+  TEST_EXPECT_TRUE(masked->GetJobMask() == mask.GetPointer());
+  TRY_EXPECT_NO_EXCEPTION(masked->Update());
+  TEST_EXPECT_TRUE(AreEqual(reference->GetOutput(), masked->GetOutput()));
+  TEST_EXPECT_EQUAL(CountPixels(masked->GetComputedRegions()), numberOfMaskLines * size[0]);
+  TEST_EXPECT_EQUAL(CountPixels(masked->GetSkippedRegions()),
+                    input->GetLargestPossibleRegion().GetNumberOfPixels() - numberOfMaskLines * size[0]);
+  // The cheap lines are grouped into fewer jobs
+  TEST_EXPECT_TRUE(masked->GetComputedRegions().size() < numberOfMaskLines);
+  // The wall time drops (about 25x less work: large margin for the machine load)
+  const double maskedTime = TimeUpdate(masked.GetPointer());
+  std::cout << "Reference: " << referenceTime << " s, JobMask: " << maskedTime << " s" << std::endl;
+  TEST_EXPECT_TRUE(maskedTime < 0.5 * referenceTime);
+
+  // JobMask with tiles: same output
+  masked->UseTilesOn();
+  masked->SetTileCacheSize(4096);
+  TRY_EXPECT_NO_EXCEPTION(masked->Update());
+  TEST_EXPECT_TRUE(AreEqual(reference->GetOutput(), masked->GetOutput()));
+  TEST_EXPECT_TRUE(CountPixels(masked->GetComputedRegions()) < input->GetLargestPossibleRegion().GetNumberOfPixels());
+  TEST_EXPECT_EQUAL(CountPixels(masked->GetComputedRegions()) + CountPixels(masked->GetSkippedRegions()),
+                    input->GetLargestPossibleRegion().GetNumberOfPixels());
+
+  // JobCostFunction: the slice 10 is much more expensive than the others.
+  // It is split into pieces, while the cheap slices before and after it are grouped.
+  FilterType::Pointer weighted = FilterType::New();
+  weighted->SetInput(input);
+  weighted->SetPixelMask(mask);
+  weighted->SetNumberOfDimensionToReduce(1);
+  weighted->SetJobCostFunction([](const ImageType::RegionType & region)
+    {
+    return region.GetNumberOfPixels() * (region.GetIndex(2) == 10 ? 1e6 : 1.0);
+    });
+  TEST_EXPECT_TRUE(static_cast< bool >(weighted->GetJobCostFunction()));
+  TRY_EXPECT_NO_EXCEPTION(weighted->Update());
+  TEST_EXPECT_TRUE(AreEqual(reference->GetOutput(), weighted->GetOutput()));
+  TEST_EXPECT_TRUE(weighted->GetSkippedRegions().empty());
+  unsigned int numberOfPieces = 0;
+  unsigned int numberOfGroups = 0;
+  for (const ImageType::RegionType & region : weighted->GetComputedRegions())
+    {
+    if (region.GetIndex(2) == 10)
+      {
+      TEST_EXPECT_EQUAL(region.GetSize(2), 1);
+      TEST_EXPECT_EQUAL(region.GetSize(0), size[0]);
+      ++numberOfPieces;
+      }
+    else
+      {
+      ++numberOfGroups;
+      }
+    }
+  TEST_EXPECT_TRUE(numberOfPieces > 1);
+  TEST_EXPECT_EQUAL(numberOfGroups, 2);
+
+  // The JobCostFunction has precedence over the JobMask
+  weighted->SetJobMask(mask);
+  TRY_EXPECT_NO_EXCEPTION(weighted->Update());
+  TEST_EXPECT_TRUE(AreEqual(reference->GetOutput(), weighted->GetOutput()));
+  TEST_EXPECT_TRUE(weighted->GetSkippedRegions().empty());
+
+  // No cost model anymore: back to the usual decomposition
+  weighted->SetJobCostFunction(FilterType::JobCostFunctionType());
+  weighted->SetJobMask(nullptr);
+  TRY_EXPECT_NO_EXCEPTION(weighted->Update());
+  TEST_EXPECT_TRUE(AreEqual(reference->GetOutput(), weighted->GetOutput()));
+  TEST_EXPECT_EQUAL(CountPixels(weighted->GetComputedRegions()), input->GetLargestPossibleRegion().GetNumberOfPixels());
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,181 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace itk {
+
+// Copies the input, and counts how many times each pixel is computed by the Jobs
+template< typename TInputImage, typename TOutputImage >
+class TBBExecutionCountingImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBExecutionCountingImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBExecutionCountingImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  // Each pixel of the requested region was computed exactly once
+  bool EachPixelComputedOnce() const
+  {
+    return std::all_of(m_ExecutionCounts.begin(), m_ExecutionCounts.end(),
+                       [](const std::atomic< unsigned int > & count) { return count == 1; });
+  }
+
+  SizeValueType GetNumberOfCalls() const { return m_NumberOfCalls; }
+
+protected:
+  TBBExecutionCountingImageFilterHelper() { m_NumberOfCalls = 0; }
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_ExecutionCounts = std::vector< std::atomic< unsigned int > >(
+      this->GetOutput()->GetBufferedRegion().GetNumberOfPixels());
+    for (std::atomic< unsigned int > & count : m_ExecutionCounts)
+      {
+      count = 0;
+      }
+    m_NumberOfCalls = 0;
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    ++m_NumberOfCalls;
+    TOutputImage * output = this->GetOutput();
+    ImageRegionConstIterator<TInputImage> iit(this->GetInput(), outputRegionForThread);
+    ImageRegionIterator<TOutputImage> oit(output, outputRegionForThread);
+    for (; !oit.IsAtEnd(); ++iit, ++oit)
+      {
+      ++m_ExecutionCounts[output->ComputeOffset(oit.GetIndex())];
+      oit.Set(static_cast< OutputImagePixelType >(iit.Get()));
+      }
+  }
+
+private:
+  std::vector< std::atomic< unsigned int > > m_ExecutionCounts;
+  std::atomic< SizeValueType >               m_NumberOfCalls;
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TImage >
+bool ImagesAreEqual(const TImage * a, const TImage * b)
+{
+  itk::ImageRegionConstIterator<TImage> ait(a, a->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> bit(b, b->GetLargestPossibleRegion());
+  for (; !ait.IsAtEnd(); ++ait, ++bit)
+    {
+    if (ait.Get() != bit.Get())
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+}
+
+// Each Job is executed exactly once by the job queue (MultiThreader) or the parallel_for (TBB),
+// whatever the number of threads and the grain size (including the grain sizes larger than the
+// number of Jobs, up to the maximum), with and without the static mapping of ParallelFirstTouch.
+int itkTBBImageToImageFilterJobQueueTest( int, char* [] )
+{
+  using ImageType = itk::Image<int, 3>;
+  using FilterType = itk::TBBExecutionCountingImageFilterHelper<ImageType, ImageType>;
+  using JobIdType = FilterType::JobIdType;
+
+  ImageType::SizeType size;
+  size[0] = 16;
+  size[1] = 13;
+  size[2] = 11;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<ImageType> iit(input, input->GetLargestPossibleRegion());
+  for (int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(value);
+    }
+
+  // Number of Jobs of the decomposition (lines)
+  FilterType::Pointer referenceFilter = FilterType::New();
+  referenceFilter->SetInput(input);
+  referenceFilter->SetNumberOfDimensionToReduce(1);
+  TRY_EXPECT_NO_EXCEPTION(referenceFilter->Update());
+  const JobIdType numberOfJobs = referenceFilter->GetNumberOfJobs();
+  TEST_EXPECT_TRUE(numberOfJobs > 1);
+
+  const JobIdType grainSizes[] = { 0, 1, 7, numberOfJobs - 1, numberOfJobs, numberOfJobs + 1,
+                                   JobIdType(1) << 31, (JobIdType(1) << 31) + 1,
+                                   itk::NumericTraits< JobIdType >::max() };
+  const itk::ThreadIdType numbersOfThreads[] = { 1, 2, 3, 4, 8 };
+
+  for (const bool parallelFirstTouch : { false, true })
+    {
+    for (const itk::ThreadIdType numberOfThreads : numbersOfThreads)
+      {
+      for (const JobIdType grainSize : grainSizes)
+        {
+        FilterType::Pointer filter = FilterType::New();
+        filter->SetInput(input);
+        filter->SetNumberOfDimensionToReduce(1);
+        filter->SetNumberOfThreads(numberOfThreads);
+        filter->SetGrainSize(grainSize);
+        filter->SetParallelFirstTouch(parallelFirstTouch);
+        TRY_EXPECT_NO_EXCEPTION(filter->Update());
+        if (!filter->EachPixelComputedOnce() || filter->GetNumberOfCalls() > numberOfJobs ||
+            !ImagesAreEqual(input.GetPointer(), filter->GetOutput()))
+          {
+          std::cerr << "Failed with " << numberOfThreads << " threads, grain size " << grainSize
+                    << " and parallel first touch " << parallelFirstTouch << std::endl;
+          return EXIT_FAILURE;
+          }
+
+        // A grain size of at least the number of Jobs: a single call
+        if (grainSize >= numberOfJobs && !parallelFirstTouch)
+          {
+          TEST_EXPECT_EQUAL(filter->GetNumberOfCalls(), 1);
+          }
+        }
+      }
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace itk {
+
+// Adds 1 to each pixel, and counts the TBBGenerateData() calls
+template< typename TInputImage, typename TOutputImage >
+class TBBCallCountingImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBCallCountingImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBCallCountingImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  unsigned int GetNumberOfCalls() const { return m_NumberOfCalls; }
+
+protected:
+  TBBCallCountingImageFilterHelper(): m_NumberOfCalls(0) {}
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_NumberOfCalls = 0;
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    ++m_NumberOfCalls;
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!oit.IsAtEnd())
+      {
+      oit.Set(oit.Get() + 1);
+      ++oit;
+      }
+  }
+
+private:
+  std::atomic< unsigned int > m_NumberOfCalls;
+};
+
+} // itk
+
+int itkTBBImageToImageFilterJobStatisticsTest( int argc, char* argv[] )
+{
+  if (argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  using ImageType = itk::Image<unsigned int, 3>;
+  using FilterType = itk::TBBCallCountingImageFilterHelper<ImageType, ImageType>;
+
+  ImageType::SizeType size;
+  size[0] = 41;
+  size[1] = 37;
+  size[2] = 23;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  input->FillBuffer(0);
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput(input);
+
+  // Off by default: nothing is recorded
+  TEST_EXPECT_TRUE(!filter->GetRecordJobStatistics());
+  TRY_EXPECT_NO_EXCEPTION(filter->Update());
+  TEST_EXPECT_TRUE(filter->GetJobRecords().empty());
+  TEST_EXPECT_EQUAL(filter->GetJobStatistics().NumberOfJobs, 0u);
+
+  // On: one record per TBBGenerateData() call, with lines, slices and tiles
+  for (int mode = 0; mode < 3; ++mode)
+    {
+    filter->RecordJobStatisticsOn();
+    if (mode == 2)
+      {
+      filter->UseTilesOn();
+      filter->SetTileCacheSize(4096);
+      }
+    else
+      {
+      filter->SetNumberOfDimensionToReduce(mode + 1);
+      }
+    filter->Modified();
+    TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+    const FilterType::JobRecordContainerType & records = filter->GetJobRecords();
+    const FilterType::JobStatisticsType & statistics = filter->GetJobStatistics();
+    TEST_EXPECT_EQUAL(records.size(), filter->GetNumberOfCalls());
+    TEST_EXPECT_EQUAL(statistics.NumberOfJobs, records.size());
+    TEST_EXPECT_TRUE(statistics.NumberOfWorkers >= 1);
+
+    // The recorded regions cover the requested region once, sorted by start time
+    ImageType::Pointer coverage = ImageType::New();
+    coverage->SetRegions(size);
+    coverage->Allocate();
+    coverage->FillBuffer(0);
+    double previousStart = 0.0;
+    double totalJobTime = 0.0;
+    for (const FilterType::JobRecordType & record : records)
+      {
+      TEST_EXPECT_TRUE(record.Start >= previousStart);
+      TEST_EXPECT_TRUE(record.End >= record.Start);
+      TEST_EXPECT_TRUE(record.End <= statistics.TotalTime);
+      TEST_EXPECT_TRUE(record.Worker < statistics.NumberOfWorkers);
+      previousStart = record.Start;
+      totalJobTime += record.End - record.Start;
+      TEST_EXPECT_TRUE(statistics.MaximumJobTime >= record.End - record.Start);
+
+      itk::ImageRegionIterator<ImageType> cit(coverage, record.Region);
+      for (; !cit.IsAtEnd(); ++cit)
+        {
+        cit.Set(cit.Get() + 1);
+        }
+      }
+    itk::ImageRegionConstIterator<ImageType> cit(coverage, coverage->GetLargestPossibleRegion());
+    for (; !cit.IsAtEnd(); ++cit)
+      {
+      TEST_EXPECT_EQUAL(cit.Get(), 1u);
+      }
+
+    // Summary
+    TEST_EXPECT_TRUE(std::abs(statistics.TotalJobTime - totalJobTime) <= 1e-9);
+    TEST_EXPECT_TRUE(statistics.MaximumJobTime >= statistics.MeanJobTime);
+    TEST_EXPECT_TRUE(std::abs(statistics.MeanJobTime * statistics.NumberOfJobs - statistics.TotalJobTime) <= 1e-9);
+    TEST_EXPECT_TRUE(statistics.TotalJobTime <= 0.0 || statistics.ImbalanceRatio >= 1.0 - 1e-9);
+    TEST_EXPECT_TRUE(statistics.IdleFraction >= 0.0 && statistics.IdleFraction <= 1.0);
+    }
+
+  // Chrome trace: one complete event per record
+  const std::string traceFileName = std::string(argv[1]) + "/itkTBBImageToImageFilterJobStatisticsTest.json";
+  TRY_EXPECT_NO_EXCEPTION(filter->WriteJobTrace(traceFileName));
+  std::ifstream traceFile(traceFileName.c_str());
+  const std::string trace((std::istreambuf_iterator<char>(traceFile)), std::istreambuf_iterator<char>());
+  TEST_EXPECT_TRUE(trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [") == 0);
+  TEST_EXPECT_TRUE(trace.rfind("]}") != std::string::npos);
+  std::string::size_type numberOfEvents = 0;
+  for (std::string::size_type position = trace.find("\"ph\": \"X\""); position != std::string::npos;
+       position = trace.find("\"ph\": \"X\"", position + 1))
+    {
+    ++numberOfEvents;
+    }
+  TEST_EXPECT_EQUAL(numberOfEvents, filter->GetJobRecords().size());
+
+  TRY_EXPECT_EXCEPTION(filter->WriteJobTrace(std::string(argv[1]) + "/nonexistent/trace.json"));
+
+  // Off again: the previous records are cleared
+  filter->RecordJobStatisticsOff();
+  filter->Modified();
+  TRY_EXPECT_NO_EXCEPTION(filter->Update());
+  TEST_EXPECT_TRUE(filter->GetJobRecords().empty());
+
+  return EXIT_SUCCESS;
+}
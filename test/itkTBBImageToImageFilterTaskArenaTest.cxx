@@ -0,0 +1,223 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace itk {
+
+// Adds 1 to each pixel, optionally running a nested filter in each job,
+// and records the largest concurrency seen by the jobs
+template< typename TInputImage, typename TOutputImage >
+class TBBNestingImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBNestingImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBNestingImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  itkSetMacro(Nested, bool);
+
+  int GetJobConcurrency() const { return m_JobConcurrency; }
+
+protected:
+  TBBNestingImageFilterHelper(): m_Nested(false), m_JobConcurrency(0) {}
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+#ifdef ITK_USE_TBB
+    int concurrency = m_JobConcurrency;
+    while (concurrency < tbb::this_task_arena::max_concurrency() &&
+           !m_JobConcurrency.compare_exchange_weak(concurrency, tbb::this_task_arena::max_concurrency()))
+      {
+      }
+#endif // ITK_USE_TBB
+
+    if (m_Nested)
+      {
+      // Run a whole filter (sharing the same threads) in each job
+      typename TInputImage::Pointer jobImage = TInputImage::New();
+      jobImage->SetRegions(outputRegionForThread.GetSize());
+      jobImage->Allocate();
+      jobImage->FillBuffer(0);
+
+      Pointer nestedFilter = Self::New();
+      nestedFilter->SetInput(jobImage);
+      nestedFilter->Update();
+      }
+
+    ImageRegionConstIterator<TInputImage> iit(this->GetInput(), outputRegionForThread);
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      oit.Set(iit.Get() + 1);
+      ++iit; ++oit;
+      }
+  }
+
+private:
+  bool               m_Nested;
+  std::atomic< int > m_JobConcurrency;
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TImage >
+bool IsIncremented(const TImage * input, const TImage * output)
+{
+  itk::ImageRegionConstIterator<TImage> iit(input, input->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> oit(output, output->GetLargestPossibleRegion());
+  while(!iit.IsAtEnd())
+    {
+    if (oit.Get() != iit.Get() + 1)
+      {
+      return false;
+      }
+    ++iit; ++oit;
+    }
+  return true;
+}
+
+}
+
+int itkTBBImageToImageFilterTaskArenaTest( int, char* [] )
+{
+  using ImageType = itk::Image<short, 2>;
+  using FilterType = itk::TBBNestingImageFilterHelper<ImageType, ImageType>;
+
+  ImageType::SizeType size;
+  size[0] = 64;
+  size[1] = 48;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  input->FillBuffer(3);
+
+#ifdef ITK_USE_TBB
+  // Filters with the same number of threads share the same arena
+  FilterType::Pointer filter1 = FilterType::New();
+  FilterType::Pointer filter2 = FilterType::New();
+  filter1->SetNumberOfThreads(2);
+  filter2->SetNumberOfThreads(2);
+  TEST_EXPECT_TRUE(filter1->GetTaskArena() == filter2->GetTaskArena());
+  TEST_EXPECT_EQUAL(filter1->GetTaskArena()->max_concurrency(), 2);
+
+  filter1->SetInput(input);
+  TRY_EXPECT_NO_EXCEPTION(filter1->Update());
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), filter1->GetOutput()));
+  TEST_EXPECT_TRUE(filter1->GetJobConcurrency() <= 2);
+
+  // An injected arena sets the number of threads, and executes the jobs
+  FilterType::TaskArenaPointer taskArena = std::make_shared< tbb::task_arena >(3);
+  FilterType::Pointer arenaFilter = FilterType::New();
+  arenaFilter->SetTaskArena(taskArena);
+  TEST_EXPECT_TRUE(arenaFilter->GetTaskArena() == taskArena);
+  TEST_EXPECT_EQUAL(arenaFilter->GetNumberOfThreads(), 3u);
+  arenaFilter->SetInput(input);
+  TRY_EXPECT_NO_EXCEPTION(arenaFilter->Update());
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), arenaFilter->GetOutput()));
+  TEST_EXPECT_EQUAL(arenaFilter->GetJobConcurrency(), 3);
+
+  // Setting the number of threads switches back to the shared arena
+  arenaFilter->SetNumberOfThreads(2);
+  TEST_EXPECT_TRUE(arenaFilter->GetTaskArena() == filter1->GetTaskArena());
+
+  // The automatic number of threads is kept after an Update() in another arena:
+  // the Jobs use the shared arena of the default concurrency
+  FilterType::Pointer automaticFilter = FilterType::New();
+  automaticFilter->SetInput(input);
+  tbb::task_arena otherArena(tbb::this_task_arena::max_concurrency() + 1);
+  TRY_EXPECT_NO_EXCEPTION(otherArena.execute([&] { automaticFilter->Update(); }));
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), automaticFilter->GetOutput()));
+  TEST_EXPECT_EQUAL(automaticFilter->GetNumberOfThreads(), 0u);
+  TEST_EXPECT_TRUE(automaticFilter->GetTaskArena() == itk::TBBTaskArenaPool::GetTaskArena(0));
+  FilterType::Pointer defaultFilter = FilterType::New();
+  defaultFilter->SetInput(input);
+  defaultFilter->SetNumberOfThreads(tbb::this_task_arena::max_concurrency());
+  TRY_EXPECT_NO_EXCEPTION(defaultFilter->Update());
+  TEST_EXPECT_EQUAL(automaticFilter->GetNumberOfJobs(), defaultFilter->GetNumberOfJobs());
+#endif // ITK_USE_TBB
+
+  // Nested filters
+  FilterType::Pointer nestingFilter = FilterType::New();
+  nestingFilter->SetInput(input);
+  nestingFilter->SetNested(true);
+  TRY_EXPECT_NO_EXCEPTION(nestingFilter->Update());
+  TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), nestingFilter->GetOutput()));
+
+  // Concurrent filters, repeatedly updated
+  std::vector< FilterType::Pointer > filters;
+  for (unsigned int i = 0; i < 4; ++i)
+    {
+    filters.push_back(FilterType::New());
+    filters.back()->SetInput(input);
+    }
+  std::atomic< int > failures(0);
+  std::vector< std::thread > threads;
+  for (unsigned int i = 0; i < filters.size(); ++i)
+    {
+    threads.emplace_back([&filters, &failures, i]
+      {
+      try
+        {
+        for (unsigned int update = 0; update < 50; ++update)
+          {
+          filters[i]->Modified();
+          filters[i]->Update();
+          }
+        }
+      catch (...)
+        {
+        ++failures;
+        }
+      });
+    }
+  for (std::thread & thread : threads)
+    {
+    thread.join();
+    }
+  TEST_EXPECT_EQUAL(failures.load(), 0);
+  for (const FilterType::Pointer & filter : filters)
+    {
+    TEST_EXPECT_TRUE(IsIncremented(input.GetPointer(), filter->GetOutput()));
+    }
+
+  return EXIT_SUCCESS;
+}
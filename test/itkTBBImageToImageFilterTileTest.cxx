@@ -0,0 +1,191 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+
+namespace itk {
+
+// 3x3x3 mean (smoothing-style workload), with zero flux Neumann boundary condition.
+// Counts the computed pixels.
+template< typename TInputImage, typename TOutputImage >
+class TBBMeanImageFilterHelper : public TBBImageToImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBMeanImageFilterHelper;
+  using Superclass = TBBImageToImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBMeanImageFilterHelper, TBBImageToImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  SizeValueType GetNumberOfComputedPixels() const { return m_NumberOfComputedPixels; }
+
+protected:
+  TBBMeanImageFilterHelper() { m_NumberOfComputedPixels = 0; }
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_NumberOfComputedPixels = 0;
+  }
+
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    m_NumberOfComputedPixels += outputRegionForThread.GetNumberOfPixels();
+    const TInputImage * input = this->GetInput();
+    TOutputImage * output = this->GetOutput();
+    const typename TInputImage::RegionType & largestRegion = input->GetLargestPossibleRegion();
+    const typename TInputImage::IndexType first = largestRegion.GetIndex();
+    const typename TInputImage::IndexType last = largestRegion.GetUpperIndex();
+    const unsigned int Dimension = TInputImage::ImageDimension;
+
+    ImageRegionIterator<TOutputImage> oit(output, outputRegionForThread);
+    while(!oit.IsAtEnd())
+      {
+      const typename TOutputImage::IndexType center = oit.GetIndex();
+
+      // Iterate over the 3^Dimension neighbors
+      double sum = 0.0;
+      unsigned int nbNeighbors = 1;
+      for (unsigned int i = 0; i < Dimension; ++i)
+        {
+        nbNeighbors *= 3;
+        }
+      for (unsigned int n = 0; n < nbNeighbors; ++n)
+        {
+        typename TInputImage::IndexType neighbor;
+        unsigned int code = n;
+        for (unsigned int i = 0; i < Dimension; ++i)
+          {
+          neighbor[i] = center[i] + static_cast<IndexValueType>(code % 3) - 1;
+          neighbor[i] = std::max(first[i], std::min(last[i], neighbor[i]));
+          code /= 3;
+          }
+        sum += input->GetPixel(neighbor);
+        }
+      oit.Set(static_cast<OutputImagePixelType>(sum / nbNeighbors));
+      ++oit;
+      }
+  }
+
+private:
+  std::atomic< SizeValueType > m_NumberOfComputedPixels;
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TImage >
+bool ImagesAreEqual(const TImage * a, const TImage * b)
+{
+  itk::ImageRegionConstIterator<TImage> ait(a, a->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<TImage> bit(b, b->GetLargestPossibleRegion());
+  while(!ait.IsAtEnd())
+    {
+    if (ait.Get() != bit.Get())
+      {
+      return false;
+      }
+    ++ait; ++bit;
+    }
+  return true;
+}
+
+}
+
+// The timings of the tiles against the slices/lines Jobs are measured by the
+// itkTBBImageToImageFilterBenchmark ("tiles" rows, and the --large volume)
+int itkTBBImageToImageFilterTileTest( int, char* [] )
+{
+  constexpr unsigned int Dimension = 3;
+  using ImageType = itk::Image<float, Dimension>;
+  using FilterType = itk::TBBMeanImageFilterHelper<ImageType, ImageType>;
+
+  // Odd sizes, so that the last tile along each dimension is smaller
+  ImageType::SizeType size;
+  size[0] = 37;
+  size[1] = 23;
+  size[2] = 19;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  const itk::SizeValueType numberOfPixels = input->GetLargestPossibleRegion().GetNumberOfPixels();
+  itk::ImageRegionIterator<ImageType> iit(input, input->GetLargestPossibleRegion());
+  for (unsigned int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(static_cast<float>((value * 7919) % 1009));
+    }
+
+  // Reference: slices/lines jobs
+  FilterType::Pointer slabFilter = FilterType::New();
+  slabFilter->SetInput(input);
+  TRY_EXPECT_NO_EXCEPTION(slabFilter->Update());
+  TEST_EXPECT_EQUAL(slabFilter->GetNumberOfComputedPixels(), numberOfPixels);
+
+  // Tiles of a fixed size
+  FilterType::TileSizeType tileSize;
+  tileSize[0] = 16;
+  tileSize[1] = 8;
+  tileSize[2] = 4;
+  FilterType::Pointer tileFilter = FilterType::New();
+  tileFilter->SetInput(input);
+  tileFilter->UseTilesOn();
+  tileFilter->SetTileSize(tileSize);
+  TRY_EXPECT_NO_EXCEPTION(tileFilter->Update());
+  TEST_EXPECT_EQUAL(tileFilter->GetNumberOfComputedPixels(), numberOfPixels);
+  TEST_EXPECT_TRUE(ImagesAreEqual(slabFilter->GetOutput(), tileFilter->GetOutput()));
+
+  // Tiles of an automatic size, with a small cache to force many tiles
+  FilterType::Pointer autoTileFilter = FilterType::New();
+  autoTileFilter->SetInput(input);
+  autoTileFilter->UseTilesOn();
+  autoTileFilter->SetTileCacheSize(1024);
+  TRY_EXPECT_NO_EXCEPTION(autoTileFilter->Update());
+  TEST_EXPECT_EQUAL(autoTileFilter->GetNumberOfComputedPixels(), numberOfPixels);
+  TEST_EXPECT_TRUE(ImagesAreEqual(slabFilter->GetOutput(), autoTileFilter->GetOutput()));
+
+  // Tiles with a partially fixed size (only along the fastest dimension)
+  tileSize.Fill(0);
+  tileSize[0] = 10;
+  FilterType::Pointer partialTileFilter = FilterType::New();
+  partialTileFilter->SetInput(input);
+  partialTileFilter->UseTilesOn();
+  partialTileFilter->SetTileSize(tileSize);
+  partialTileFilter->SetTileCacheSize(2048);
+  TRY_EXPECT_NO_EXCEPTION(partialTileFilter->Update());
+  TEST_EXPECT_EQUAL(partialTileFilter->GetNumberOfComputedPixels(), numberOfPixels);
+  TEST_EXPECT_TRUE(ImagesAreEqual(slabFilter->GetOutput(), partialTileFilter->GetOutput()));
+
+  return EXIT_SUCCESS;
+}
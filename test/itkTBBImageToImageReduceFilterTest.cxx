@@ -0,0 +1,345 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBImageToImageReduceFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace itk {
+
+// Sum of the pixels (integer accumulator, so the result doesn't depend on the join order).
+// With NestedFilters, each Job also updates a filter of the same type on its own small image
+// (in the same task arena with TBB, so the waiting thread may execute the other Jobs), and counts
+// the nested errors (accumulator of the Job not initialized or changed by another Job, wrong
+// nested sum, or job thread id changed).
+template< typename TImage >
+class TBBSumImageFilterHelper : public TBBImageToImageReduceFilter< TImage, TImage, long >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBSumImageFilterHelper;
+  using Superclass = TBBImageToImageReduceFilter< TImage, TImage, long >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using AccumulatorType = typename Superclass::AccumulatorType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBSumImageFilterHelper, TBBImageToImageReduceFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  itkGetConstMacro(Sum, long);
+
+  itkSetMacro(NestedFilters, bool);
+  SizeValueType GetNumberOfNestedErrors() const { return m_NumberOfNestedErrors; }
+
+protected:
+  TBBSumImageFilterHelper(): m_Sum(0), m_NestedFilters(false) { m_NumberOfNestedErrors = 0; }
+
+  void BeforeThreadedGenerateData() override
+  {
+    Superclass::BeforeThreadedGenerateData();
+    m_NumberOfNestedErrors = 0;
+  }
+
+  using Superclass::TBBGenerateData;
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread, AccumulatorType& sum) override
+  {
+    if (m_NestedFilters)
+      {
+      const AccumulatorType sumBefore = sum;
+      this->UpdateNestedFilter();
+      if (sumBefore != 0 || sum != sumBefore)
+        {
+        ++m_NumberOfNestedErrors;
+        }
+      }
+
+    ImageRegionConstIterator<TImage> iit(this->GetInput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      sum += iit.Get();
+      ++iit;
+      }
+  }
+
+  void InitializeAccumulator(AccumulatorType& sum) const override
+  {
+    sum = 0;
+  }
+
+  void JoinAccumulators(AccumulatorType& sum, const AccumulatorType& other) const override
+  {
+    sum += other;
+  }
+
+  void TBBReduceData(const AccumulatorType& sum) override
+  {
+    m_Sum = sum;
+  }
+
+private:
+  void UpdateNestedFilter()
+  {
+#ifndef ITK_USE_TBB
+    const ThreadIdType threadId = this->GetJobThreadId();
+#endif // ITK_USE_TBB
+
+    typename TImage::SizeType size;
+    size.Fill(8);
+    typename TImage::Pointer nestedInput = TImage::New();
+    nestedInput->SetRegions(size);
+    nestedInput->Allocate();
+    nestedInput->FillBuffer(1);
+    Pointer nestedFilter = Self::New();
+    nestedFilter->SetInput(nestedInput);
+#ifdef ITK_USE_TBB
+    nestedFilter->SetTaskArena(this->GetTaskArena());
+#else
+    nestedFilter->SetNumberOfThreads(2);
+#endif // ITK_USE_TBB
+    nestedFilter->Update();
+
+    bool error = (nestedFilter->GetSum() != static_cast< long >(nestedInput->GetLargestPossibleRegion().GetNumberOfPixels()));
+#ifndef ITK_USE_TBB
+    error |= (this->GetJobThreadId() != threadId);
+#endif // ITK_USE_TBB
+    if (error)
+      {
+      ++m_NumberOfNestedErrors;
+      }
+  }
+
+  long                         m_Sum;
+  bool                         m_NestedFilters;
+  std::atomic< SizeValueType > m_NumberOfNestedErrors;
+};
+
+// Minimum and maximum of the pixels
+template< typename TImage >
+class TBBMinimumMaximumImageFilterHelper :
+  public TBBImageToImageReduceFilter< TImage, TImage, std::pair< typename TImage::PixelType, typename TImage::PixelType > >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBMinimumMaximumImageFilterHelper;
+  using PixelType = typename TImage::PixelType;
+  using Superclass = TBBImageToImageReduceFilter< TImage, TImage, std::pair< PixelType, PixelType > >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using AccumulatorType = typename Superclass::AccumulatorType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBMinimumMaximumImageFilterHelper, TBBImageToImageReduceFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+protected:
+  TBBMinimumMaximumImageFilterHelper() {}
+
+  using Superclass::TBBGenerateData;
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread, AccumulatorType& minMax) override
+  {
+    ImageRegionConstIterator<TImage> iit(this->GetInput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      minMax.first = std::min(minMax.first, iit.Get());
+      minMax.second = std::max(minMax.second, iit.Get());
+      ++iit;
+      }
+  }
+
+  void InitializeAccumulator(AccumulatorType& minMax) const override
+  {
+    minMax.first = NumericTraits< PixelType >::max();
+    minMax.second = NumericTraits< PixelType >::NonpositiveMin();
+  }
+
+  void JoinAccumulators(AccumulatorType& minMax, const AccumulatorType& other) const override
+  {
+    minMax.first = std::min(minMax.first, other.first);
+    minMax.second = std::max(minMax.second, other.second);
+  }
+};
+
+// Histogram of the pixels, with one bin per value in [0, NumberOfBins[
+template< typename TImage >
+class TBBHistogramImageFilterHelper : public TBBImageToImageReduceFilter< TImage, TImage, std::vector< SizeValueType > >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBHistogramImageFilterHelper;
+  using Superclass = TBBImageToImageReduceFilter< TImage, TImage, std::vector< SizeValueType > >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using AccumulatorType = typename Superclass::AccumulatorType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBHistogramImageFilterHelper, TBBImageToImageReduceFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  itkSetMacro(NumberOfBins, unsigned int);
+
+protected:
+  TBBHistogramImageFilterHelper(): m_NumberOfBins(1) {}
+
+  using Superclass::TBBGenerateData;
+  void TBBGenerateData(const OutputImageRegionType& outputRegionForThread, AccumulatorType& histogram) override
+  {
+    ImageRegionConstIterator<TImage> iit(this->GetInput(), outputRegionForThread);
+    while(!iit.IsAtEnd())
+      {
+      ++histogram[iit.Get()];
+      ++iit;
+      }
+  }
+
+  void InitializeAccumulator(AccumulatorType& histogram) const override
+  {
+    histogram.assign(m_NumberOfBins, 0);
+  }
+
+  void JoinAccumulators(AccumulatorType& histogram, const AccumulatorType& other) const override
+  {
+    for (unsigned int bin = 0; bin < m_NumberOfBins; ++bin)
+      {
+      histogram[bin] += other[bin];
+      }
+  }
+
+private:
+  unsigned int m_NumberOfBins;
+};
+
+} // itk
+
+int itkTBBImageToImageReduceFilterTest( int, char* [] )
+{
+  constexpr unsigned int Dimension = 3;
+  constexpr unsigned int NumberOfBins = 37;
+  using ImageType = itk::Image<short, Dimension>;
+
+  ImageType::SizeType size;
+  size[0] = 31;
+  size[1] = 29;
+  size[2] = 23;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+
+  itk::ImageRegionIterator<ImageType> iit(input, input->GetLargestPossibleRegion());
+  for (unsigned int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(static_cast<short>((value * 7919) % NumberOfBins));
+    }
+
+  // Two outliers for the minimum and maximum
+  const ImageType::IndexType firstIndex = input->GetLargestPossibleRegion().GetIndex();
+  const ImageType::IndexType lastIndex = input->GetLargestPossibleRegion().GetUpperIndex();
+  const short firstValue = input->GetPixel(firstIndex);
+  const short lastValue = input->GetPixel(lastIndex);
+  input->SetPixel(firstIndex, -5);
+  input->SetPixel(lastIndex, 1000);
+
+  // Expected sum, computed serially
+  long expectedSum = 0;
+  for (iit.GoToBegin(); !iit.IsAtEnd(); ++iit)
+    {
+    expectedSum += iit.Get();
+    }
+
+  // Sum, with lines, slices and tiles, and repeated updates
+  using SumFilterType = itk::TBBSumImageFilterHelper<ImageType>;
+  for (int mode = 0; mode < 3; ++mode)
+    {
+    SumFilterType::Pointer sumFilter = SumFilterType::New();
+    sumFilter->SetInput(input);
+    if (mode == 2)
+      {
+      sumFilter->UseTilesOn();
+      sumFilter->SetTileCacheSize(4096);
+      }
+    else
+      {
+      sumFilter->SetNumberOfDimensionToReduce(mode + 1);
+      }
+    for (int update = 0; update < 2; ++update)
+      {
+      sumFilter->Modified();
+      TRY_EXPECT_NO_EXCEPTION(sumFilter->Update());
+      TEST_EXPECT_EQUAL(sumFilter->GetSum(), expectedSum);
+      TEST_EXPECT_EQUAL(sumFilter->GetAccumulator(), expectedSum);
+      }
+    }
+
+  // Filters of the same type nested in the Jobs: each Job keeps its accumulator
+  SumFilterType::Pointer nestingFilter = SumFilterType::New();
+  nestingFilter->SetInput(input);
+  nestingFilter->SetNumberOfThreads(4);
+  nestingFilter->SetGrainSize(1);
+  nestingFilter->SetNestedFilters(true);
+  TRY_EXPECT_NO_EXCEPTION(nestingFilter->Update());
+  TEST_EXPECT_EQUAL(nestingFilter->GetNumberOfNestedErrors(), 0);
+  TEST_EXPECT_EQUAL(nestingFilter->GetSum(), expectedSum);
+
+  // Minimum and maximum
+  using MinimumMaximumFilterType = itk::TBBMinimumMaximumImageFilterHelper<ImageType>;
+  MinimumMaximumFilterType::Pointer minMaxFilter = MinimumMaximumFilterType::New();
+  minMaxFilter->SetInput(input);
+  TRY_EXPECT_NO_EXCEPTION(minMaxFilter->Update());
+  TEST_EXPECT_EQUAL(minMaxFilter->GetAccumulator().first, -5);
+  TEST_EXPECT_EQUAL(minMaxFilter->GetAccumulator().second, 1000);
+
+  // Histogram (without the two outliers), expected histogram computed serially
+  input->SetPixel(firstIndex, firstValue);
+  input->SetPixel(lastIndex, lastValue);
+  std::vector< itk::SizeValueType > expectedHistogram(NumberOfBins, 0);
+  for (iit.GoToBegin(); !iit.IsAtEnd(); ++iit)
+    {
+    ++expectedHistogram[iit.Get()];
+    }
+
+  using HistogramFilterType = itk::TBBHistogramImageFilterHelper<ImageType>;
+  HistogramFilterType::Pointer histogramFilter = HistogramFilterType::New();
+  histogramFilter->SetInput(input);
+  histogramFilter->SetNumberOfBins(NumberOfBins);
+  histogramFilter->SetGrainSize(3);
+  TRY_EXPECT_NO_EXCEPTION(histogramFilter->Update());
+  TEST_EXPECT_TRUE(histogramFilter->GetAccumulator() == expectedHistogram);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,340 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBNeighborhoodImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+namespace itk {
+
+// Box mean of the given radius, with zero flux Neumann boundary condition.
+// The interior Jobs read the neighbors without any check, the boundary Jobs clamp them.
+// Records the Jobs (region, interior or boundary) in the order they are started.
+template< typename TInputImage, typename TOutputImage >
+class TBBBoxMeanImageFilterHelper : public TBBNeighborhoodImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBBoxMeanImageFilterHelper;
+  using Superclass = TBBNeighborhoodImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBBoxMeanImageFilterHelper, TBBNeighborhoodImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  struct JobType
+    {
+    OutputImageRegionType Region;
+    bool                  Interior;
+    };
+
+  const std::vector< JobType > & GetJobs() const { return m_Jobs; }
+  bool GetInteriorReadOutsideOfBuffer() const { return m_InteriorReadOutsideOfBuffer; }
+
+protected:
+  TBBBoxMeanImageFilterHelper(): m_InteriorReadOutsideOfBuffer(false) {}
+
+  void BeforeThreadedGenerateData() override
+  {
+    m_Jobs.clear();
+    m_InteriorReadOutsideOfBuffer = false;
+  }
+
+  void TBBGenerateInteriorData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    this->RecordJob(outputRegionForThread, true);
+    this->ComputeMean(outputRegionForThread, false);
+  }
+
+  void TBBGenerateBoundaryData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    this->RecordJob(outputRegionForThread, false);
+    this->ComputeMean(outputRegionForThread, true);
+  }
+
+private:
+  void RecordJob(const OutputImageRegionType& region, bool interior)
+  {
+    std::lock_guard< std::mutex > lock(m_Mutex);
+    m_Jobs.push_back(JobType{ region, interior });
+  }
+
+  void ComputeMean(const OutputImageRegionType& region, bool checked)
+  {
+    const TInputImage * input = this->GetInput();
+    const typename TInputImage::RegionType & bufferedRegion = input->GetBufferedRegion();
+    const typename TInputImage::IndexType first = input->GetLargestPossibleRegion().GetIndex();
+    const typename TInputImage::IndexType last = input->GetLargestPossibleRegion().GetUpperIndex();
+    const typename Superclass::RadiusType & radius = this->GetRadius();
+    const unsigned int Dimension = TInputImage::ImageDimension;
+
+    SizeValueType nbNeighbors = 1;
+    for (unsigned int i = 0; i < Dimension; ++i)
+      {
+      nbNeighbors *= 2 * radius[i] + 1;
+      }
+
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), region);
+    for (; !oit.IsAtEnd(); ++oit)
+      {
+      const typename TOutputImage::IndexType center = oit.GetIndex();
+      double sum = 0.0;
+      for (SizeValueType n = 0; n < nbNeighbors; ++n)
+        {
+        typename TInputImage::IndexType neighbor;
+        SizeValueType code = n;
+        for (unsigned int i = 0; i < Dimension; ++i)
+          {
+          neighbor[i] = center[i] + static_cast<IndexValueType>(code % (2 * radius[i] + 1))
+                        - static_cast<IndexValueType>(radius[i]);
+          code /= 2 * radius[i] + 1;
+          if (checked)
+            {
+            neighbor[i] = std::max(first[i], std::min(last[i], neighbor[i]));
+            }
+          }
+        if (!bufferedRegion.IsInside(neighbor))
+          {
+          // Only possible on the (wrong) fast path
+          m_InteriorReadOutsideOfBuffer = true;
+          continue;
+          }
+        sum += input->GetPixel(neighbor);
+        }
+      oit.Set(static_cast<OutputImagePixelType>(sum / nbNeighbors));
+      }
+  }
+
+  std::mutex             m_Mutex;
+  std::vector< JobType > m_Jobs;
+  std::atomic< bool >    m_InteriorReadOutsideOfBuffer;
+};
+
+} // itk
+
+namespace
+{
+
+// Brute force box mean, with zero flux Neumann boundary condition
+template< typename TInputImage, typename TOutputImage >
+bool IsBoxMean(const TInputImage * input, const TOutputImage * output,
+               const typename TOutputImage::RegionType & region, const typename TInputImage::SizeType & radius)
+{
+  const unsigned int Dimension = TInputImage::ImageDimension;
+  const typename TInputImage::IndexType first = input->GetLargestPossibleRegion().GetIndex();
+  const typename TInputImage::IndexType last = input->GetLargestPossibleRegion().GetUpperIndex();
+
+  typename TInputImage::RegionType box;
+  for (unsigned int i = 0; i < Dimension; ++i)
+    {
+    box.SetIndex(i, -static_cast<itk::IndexValueType>(radius[i]));
+    box.SetSize(i, 2 * radius[i] + 1);
+    }
+
+  itk::ImageRegionConstIterator<TOutputImage> oit(output, region);
+  for (; !oit.IsAtEnd(); ++oit)
+    {
+    double sum = 0.0;
+    for (typename TInputImage::IndexType offset = box.GetIndex(); ; )
+      {
+      typename TInputImage::IndexType neighbor;
+      for (unsigned int i = 0; i < Dimension; ++i)
+        {
+        neighbor[i] = std::max(first[i], std::min(last[i], oit.GetIndex()[i] + offset[i]));
+        }
+      sum += input->GetPixel(neighbor);
+
+      unsigned int dim = 0;
+      for (; dim < Dimension; ++dim)
+        {
+        if (++offset[dim] <= static_cast<itk::IndexValueType>(radius[dim]))
+          {
+          break;
+          }
+        offset[dim] = -static_cast<itk::IndexValueType>(radius[dim]);
+        }
+      if (dim == Dimension)
+        {
+        break;
+        }
+      }
+    const double expected = sum / box.GetNumberOfPixels();
+    if (std::abs(oit.Get() - expected) > 1e-3)
+      {
+      std::cerr << "Wrong mean at " << oit.GetIndex() << ": " << oit.Get() << " instead of " << expected << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+}
+
+int itkTBBNeighborhoodImageFilterTest( int, char* [] )
+{
+  constexpr unsigned int Dimension = 3;
+  using InputImageType = itk::Image<short, Dimension>;
+  using OutputImageType = itk::Image<float, Dimension>;
+  using FilterType = itk::TBBBoxMeanImageFilterHelper<InputImageType, OutputImageType>;
+  using JobType = FilterType::JobType;
+
+  InputImageType::SizeType size;
+  size[0] = 23;
+  size[1] = 17;
+  size[2] = 19;
+  InputImageType::Pointer input = InputImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<InputImageType> iit(input, input->GetLargestPossibleRegion());
+  for (unsigned int value = 0; !iit.IsAtEnd(); ++iit, ++value)
+    {
+    iit.Set(static_cast<short>((value * 7919) % 1009));
+    }
+
+  FilterType::RadiusType anisotropicRadius;
+  anisotropicRadius[0] = 3;
+  anisotropicRadius[1] = 0;
+  anisotropicRadius[2] = 2;
+  FilterType::RadiusType largeRadius;
+  largeRadius.Fill(12);
+  const FilterType::RadiusType radii[] = { FilterType::RadiusType(), anisotropicRadius, largeRadius };
+
+  for (unsigned int r = 0; r < 3; ++r)
+    {
+    FilterType::RadiusType radius = radii[r];
+    if (r == 0)
+      {
+      radius.Fill(1);
+      }
+
+    // Slices, lines and tiles
+    for (int mode = 0; mode < 3; ++mode)
+      {
+      FilterType::Pointer filter = FilterType::New();
+      filter->SetInput(input);
+      filter->SetRadius(radius);
+      if (mode == 2)
+        {
+        filter->UseTilesOn();
+        filter->SetTileCacheSize(1024);
+        }
+      else
+        {
+        filter->SetNumberOfDimensionToReduce(mode + 1);
+        }
+#ifndef ITK_USE_TBB
+      // Jobs started in order
+      filter->SetNumberOfThreads(1);
+#endif // ITK_USE_TBB
+      TRY_EXPECT_NO_EXCEPTION(filter->Update());
+
+      const OutputImageType::RegionType & requestedRegion = filter->GetOutput()->GetRequestedRegion();
+      TEST_EXPECT_TRUE(IsBoxMean(input.GetPointer(), filter->GetOutput(), requestedRegion, radius));
+      TEST_EXPECT_TRUE(!filter->GetInteriorReadOutsideOfBuffer());
+
+      // The interior and the faces cover the requested region
+      const OutputImageType::RegionType & interior = filter->GetInteriorRegion();
+      itk::SizeValueType numberOfPixels = interior.GetNumberOfPixels();
+      for (const OutputImageType::RegionType & face : filter->GetBoundaryFaces())
+        {
+        numberOfPixels += face.GetNumberOfPixels();
+        TEST_EXPECT_TRUE(requestedRegion.IsInside(face));
+        }
+      TEST_EXPECT_EQUAL(numberOfPixels, requestedRegion.GetNumberOfPixels());
+      if (r == 2)
+        {
+        // The neighborhoods of all the pixels cross the image
+        TEST_EXPECT_EQUAL(interior.GetNumberOfPixels(), 0u);
+        }
+      else
+        {
+        OutputImageType::RegionType paddedInterior = interior;
+        paddedInterior.PadByRadius(radius);
+        TEST_EXPECT_TRUE(input->GetBufferedRegion().IsInside(paddedInterior));
+        TEST_EXPECT_TRUE(interior.GetNumberOfPixels() > 0);
+        }
+
+      // Interior jobs in the interior only, and every pixel computed once
+      itk::SizeValueType jobPixels = 0;
+      bool interiorStarted = false;
+      bool boundaryAfterInterior = false;
+      for (const JobType & job : filter->GetJobs())
+        {
+        jobPixels += job.Region.GetNumberOfPixels();
+        if (job.Interior)
+          {
+          TEST_EXPECT_TRUE(interior.IsInside(job.Region));
+          interiorStarted = true;
+          }
+        else
+          {
+          boundaryAfterInterior |= interiorStarted;
+          }
+        }
+      TEST_EXPECT_EQUAL(jobPixels, requestedRegion.GetNumberOfPixels());
+#ifndef ITK_USE_TBB
+      TEST_EXPECT_TRUE(!boundaryAfterInterior);
+#else
+      std::cout << "Boundary job started after an interior job: " << (boundaryAfterInterior ? "yes" : "no") << std::endl;
+#endif // ITK_USE_TBB
+      }
+    }
+
+  // Requested sub-region: the input requested region is padded by the radius
+  InputImageType::IndexType subIndex;
+  subIndex[0] = 2;
+  subIndex[1] = 6;
+  subIndex[2] = 4;
+  InputImageType::SizeType subSize;
+  subSize[0] = 12;
+  subSize[1] = 11;
+  subSize[2] = 5;
+  const OutputImageType::RegionType subRegion(subIndex, subSize);
+  FilterType::Pointer subRegionFilter = FilterType::New();
+  subRegionFilter->SetInput(input);
+  subRegionFilter->SetRadius(anisotropicRadius);
+  subRegionFilter->GetOutput()->SetRequestedRegion(subRegion);
+  TRY_EXPECT_NO_EXCEPTION(subRegionFilter->Update());
+  TEST_EXPECT_TRUE(IsBoxMean(input.GetPointer(), subRegionFilter->GetOutput(), subRegion, anisotropicRadius));
+
+  InputImageType::RegionType expectedInputRegion = subRegion;
+  expectedInputRegion.PadByRadius(anisotropicRadius);
+  expectedInputRegion.Crop(input->GetLargestPossibleRegion());
+  TEST_EXPECT_TRUE(input->GetRequestedRegion() == expectedInputRegion);
+
+  // Only the low face along x (the other neighborhoods are inside the image)
+  TEST_EXPECT_EQUAL(subRegionFilter->GetBoundaryFaces().size(), 1u);
+  TEST_EXPECT_EQUAL(subRegionFilter->GetBoundaryFaces()[0].GetSize(0), 1u);
+
+  return EXIT_SUCCESS;
+}
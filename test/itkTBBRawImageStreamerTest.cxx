@@ -0,0 +1,267 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkTBBRawImageStreamer.h"
+#include "itkTBBNeighborhoodImageFilter.h"
+
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIterator.h>
+#include <itkTestingMacros.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace itk {
+
+// Box mean of the given radius, with zero flux Neumann boundary condition
+// (the neighbors are clamped in all the Jobs). Throws when it computes the FailingSlice.
+template< typename TInputImage, typename TOutputImage >
+class TBBClampedMeanImageFilterHelper : public TBBNeighborhoodImageFilter< TInputImage, TOutputImage >
+{
+public:
+  // Standard class type alias.
+  using Self = TBBClampedMeanImageFilterHelper;
+  using Superclass = TBBNeighborhoodImageFilter< TInputImage, TOutputImage >;
+  using Pointer = SmartPointer< Self >;
+  using ConstPointer = SmartPointer< const Self >;
+
+  // Superclass type alias.
+  using OutputImageRegionType = typename Superclass::OutputImageRegionType;
+  using OutputImagePixelType = typename Superclass::OutputImagePixelType;
+
+  // Run-time type information (and related methods).
+  itkTypeMacro(TBBClampedMeanImageFilterHelper, TBBNeighborhoodImageFilter);
+
+  // Method for creation through the object factory
+  itkNewMacro(Self);
+
+  itkSetMacro(FailingSlice, IndexValueType);
+
+protected:
+  TBBClampedMeanImageFilterHelper(): m_FailingSlice(-1) {}
+
+  void TBBGenerateInteriorData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    this->ComputeMean(outputRegionForThread);
+  }
+
+  void TBBGenerateBoundaryData(const OutputImageRegionType& outputRegionForThread) override
+  {
+    this->ComputeMean(outputRegionForThread);
+  }
+
+private:
+  void ComputeMean(const OutputImageRegionType& region)
+  {
+    const unsigned int lastDimension = TInputImage::ImageDimension - 1;
+    if (m_FailingSlice >= region.GetIndex(lastDimension) &&
+        m_FailingSlice < region.GetIndex(lastDimension) + static_cast< IndexValueType >(region.GetSize(lastDimension)))
+      {
+      itkExceptionMacro(<< "Failing slice " << m_FailingSlice);
+      }
+
+    const TInputImage * input = this->GetInput();
+    const typename TInputImage::IndexType first = input->GetLargestPossibleRegion().GetIndex();
+    const typename TInputImage::IndexType last = input->GetLargestPossibleRegion().GetUpperIndex();
+    const typename Superclass::RadiusType & radius = this->GetRadius();
+    const unsigned int Dimension = TInputImage::ImageDimension;
+
+    SizeValueType nbNeighbors = 1;
+    for (unsigned int i = 0; i < Dimension; ++i)
+      {
+      nbNeighbors *= 2 * radius[i] + 1;
+      }
+
+    ImageRegionIterator<TOutputImage> oit(this->GetOutput(), region);
+    for (; !oit.IsAtEnd(); ++oit)
+      {
+      const typename TOutputImage::IndexType center = oit.GetIndex();
+      double sum = 0.0;
+      for (SizeValueType n = 0; n < nbNeighbors; ++n)
+        {
+        typename TInputImage::IndexType neighbor;
+        SizeValueType code = n;
+        for (unsigned int i = 0; i < Dimension; ++i)
+          {
+          neighbor[i] = center[i] + static_cast<IndexValueType>(code % (2 * radius[i] + 1))
+                        - static_cast<IndexValueType>(radius[i]);
+          neighbor[i] = std::max(first[i], std::min(last[i], neighbor[i]));
+          code /= 2 * radius[i] + 1;
+          }
+        sum += input->GetPixel(neighbor);
+        }
+      oit.Set(static_cast<OutputImagePixelType>(sum / nbNeighbors));
+      }
+  }
+
+  IndexValueType m_FailingSlice;
+};
+
+} // itk
+
+namespace
+{
+
+template< typename TImage >
+void WriteRawFile(const std::string & fileName, const TImage * image, itk::SizeValueType numberOfPixels)
+{
+  std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast< const char * >(image->GetBufferPointer()),
+             static_cast< std::streamsize >(numberOfPixels * sizeof(typename TImage::PixelType)));
+}
+
+// The raw file holds exactly the pixels of the image
+template< typename TImage >
+bool IsEqualToRawFile(const TImage * image, const std::string & fileName)
+{
+  using PixelType = typename TImage::PixelType;
+  const itk::SizeValueType numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+  std::vector< PixelType > pixels(numberOfPixels + 1);
+  file.read(reinterpret_cast< char * >(pixels.data()), static_cast< std::streamsize >(pixels.size() * sizeof(PixelType)));
+  if (static_cast< itk::SizeValueType >(file.gcount()) != numberOfPixels * sizeof(PixelType))
+    {
+    return false;
+    }
+  return std::equal(pixels.begin(), pixels.end() - 1, image->GetBufferPointer());
+}
+
+}
+
+int itkTBBRawImageStreamerTest( int argc, char* argv[] )
+{
+  if (argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  using ImageType = itk::Image<float, 3>;
+  using FilterType = itk::TBBClampedMeanImageFilterHelper<ImageType, ImageType>;
+  using StreamerType = itk::TBBRawImageStreamer<FilterType>;
+
+  const std::string inputFileName = std::string(argv[1]) + "/itkTBBRawImageStreamerTestInput.raw";
+  const std::string outputFileName = std::string(argv[1]) + "/itkTBBRawImageStreamerTestOutput.raw";
+
+  // Input file: 64 x 48 x 40 floats (480 KiB)
+  ImageType::SizeType size;
+  size[0] = 64;
+  size[1] = 48;
+  size[2] = 40;
+  ImageType::Pointer input = ImageType::New();
+  input->SetRegions(size);
+  input->Allocate();
+  itk::ImageRegionIterator<ImageType> iit(input, input->GetLargestPossibleRegion());
+  for (; !iit.IsAtEnd(); ++iit)
+    {
+    const ImageType::IndexType index = iit.GetIndex();
+    iit.Set(static_cast< float >((index[0] * 7 + index[1] * 13 + index[2] * 31) % 101) * 0.5f);
+    }
+  const itk::SizeValueType fileSize = input->GetLargestPossibleRegion().GetNumberOfPixels() * sizeof(float);
+  WriteRawFile(inputFileName, input.GetPointer(), input->GetLargestPossibleRegion().GetNumberOfPixels());
+
+  FilterType::RadiusType radius;
+  radius[0] = 1;
+  radius[1] = 1;
+  radius[2] = 2;
+
+  // Reference: the whole image in memory
+  FilterType::Pointer reference = FilterType::New();
+  reference->SetRadius(radius);
+  reference->SetInput(input);
+  TRY_EXPECT_NO_EXCEPTION(reference->Update());
+
+  // Streamed within a budget smaller than the file: same output
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetRadius(radius);
+  StreamerType::Pointer streamer = StreamerType::New();
+  TEST_EXPECT_EQUAL(streamer->GetMemoryBudget(), 256 * 1024 * 1024);
+  TEST_EXPECT_EQUAL(streamer->GetSlabThickness(), 0);
+  streamer->SetFilter(filter);
+  streamer->SetInputFileName(inputFileName);
+  streamer->SetOutputFileName(outputFileName);
+  streamer->SetSize(size);
+  streamer->SetMemoryBudget(200 * 1024);
+  TEST_EXPECT_TRUE(streamer->GetModifiableFilter() == filter.GetPointer());
+  TEST_EXPECT_EQUAL(streamer->GetInputFileName(), inputFileName);
+  TEST_EXPECT_TRUE(streamer->GetMemoryBudget() < fileSize);
+  TRY_EXPECT_NO_EXCEPTION(streamer->Update());
+  std::cout << "Budget: " << streamer->GetMemoryBudget() << " bytes, " << streamer->GetNumberOfSlabs()
+            << " slabs, buffers: " << streamer->GetBufferSize() << " bytes" << std::endl;
+  TEST_EXPECT_TRUE(streamer->GetNumberOfSlabs() > 1);
+  TEST_EXPECT_TRUE(streamer->GetBufferSize() <= streamer->GetMemoryBudget());
+  TEST_EXPECT_TRUE(IsEqualToRawFile(reference->GetOutput(), outputFileName));
+
+  // Explicit slab thickness: the last slab is thinner
+  streamer->SetSlabThickness(7);
+  TRY_EXPECT_NO_EXCEPTION(streamer->Update());
+  TEST_EXPECT_EQUAL(streamer->GetNumberOfSlabs(), 6);
+  TEST_EXPECT_TRUE(IsEqualToRawFile(reference->GetOutput(), outputFileName));
+
+  // Slabs thicker than the image: a single slab
+  streamer->SetSlabThickness(100);
+  TRY_EXPECT_NO_EXCEPTION(streamer->Update());
+  TEST_EXPECT_EQUAL(streamer->GetNumberOfSlabs(), 1);
+  TEST_EXPECT_TRUE(IsEqualToRawFile(reference->GetOutput(), outputFileName));
+  streamer->SetSlabThickness(0);
+
+  // Budget smaller than a slice (with the halo): one slice per slab
+  streamer->SetMemoryBudget(1024);
+  TRY_EXPECT_NO_EXCEPTION(streamer->Update());
+  TEST_EXPECT_EQUAL(streamer->GetNumberOfSlabs(), size[2]);
+  TEST_EXPECT_TRUE(IsEqualToRawFile(reference->GetOutput(), outputFileName));
+  streamer->SetMemoryBudget(200 * 1024);
+
+  // Errors: missing, too small and unwritable files, and no filter
+  streamer->SetInputFileName(std::string(argv[1]) + "/nonexistent/input.raw");
+  TRY_EXPECT_EXCEPTION(streamer->Update());
+  const std::string smallFileName = std::string(argv[1]) + "/itkTBBRawImageStreamerTestSmall.raw";
+  WriteRawFile(smallFileName, input.GetPointer(), 1000);
+  streamer->SetInputFileName(smallFileName);
+  TRY_EXPECT_EXCEPTION(streamer->Update());
+  streamer->SetInputFileName(inputFileName);
+  streamer->SetOutputFileName(std::string(argv[1]) + "/nonexistent/output.raw");
+  TRY_EXPECT_EXCEPTION(streamer->Update());
+  streamer->SetOutputFileName(outputFileName);
+  StreamerType::Pointer noFilter = StreamerType::New();
+  noFilter->SetInputFileName(inputFileName);
+  noFilter->SetOutputFileName(outputFileName);
+  noFilter->SetSize(size);
+  TRY_EXPECT_EXCEPTION(noFilter->Update());
+
+  // Error in the filter: the filter is disconnected from the slab buffers
+  filter->SetNumberOfThreads(1);
+  filter->SetFailingSlice(20);
+  TRY_EXPECT_EXCEPTION(streamer->Update());
+  TEST_EXPECT_TRUE(filter->GetInput()->GetBufferPointer() == nullptr);
+  TEST_EXPECT_TRUE(filter->GetReleaseDataBeforeUpdateFlag());
+  filter->SetFailingSlice(-1);
+  filter->SetNumberOfThreads(0);
+
+  // The streamer still works after the errors
+  TRY_EXPECT_NO_EXCEPTION(streamer->Update());
+  TEST_EXPECT_TRUE(IsEqualToRawFile(reference->GetOutput(), outputFileName));
+  TEST_EXPECT_TRUE(filter->GetInput()->GetBufferPointer() == nullptr);
+  TEST_EXPECT_TRUE(filter->GetReleaseDataBeforeUpdateFlag());
+
+  streamer->Print(std::cout);
+
+  return EXIT_SUCCESS;
+}